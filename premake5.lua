@@ -49,7 +49,7 @@ workspace "librw"
 	filter {}
 
 	filter "configurations:Debug"
-		defines { "DEBUG" }
+		defines { "DEBUG", "RW_MEMDEBUG" }
 		symbols "On"
 	filter "configurations:Release*"
 		defines { "NDEBUG" }
@@ -119,6 +119,18 @@ project "dumprwtree"
 	libdirs { Libdir }
 	links { "librw" }
 
+project "perftest"
+	kind "ConsoleApp"
+	targetdir (Bindir)
+	removeplatforms { "*gl3", "*d3d9", "ps2" }
+	files { "tools/perftest/*" }
+	includedirs { "." }
+	libdirs { Libdir }
+	links { "librw" }
+	filter "system:linux"
+		links { "pthread" }
+	filter {}
+
 function findlibs()
 	filter { "platforms:linux*gl3" }
 		links { "GL", "GLEW" }
@@ -12,6 +12,7 @@
 #include "src/rwanim.h"
 #include "src/rwplugins.h"
 #include "src/rwuserdata.h"
+#include "src/rwloader.h"
 #include "src/ps2/rwps2.h"
 #include "src/ps2/rwps2plg.h"
 #include "src/d3d/rwxbox.h"
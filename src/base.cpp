@@ -5,19 +5,48 @@
 #include <cmath>
 #include <cctype>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif !defined(RW_PS2)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef RW_PS2
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#define RW_SSE2
+#include <emmintrin.h>
+// The NEON kernels have never been built, define RW_USE_NEON
+// to try them and check them with tools/perftest
+#elif defined(RW_USE_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define RW_NEON
+#include <arm_neon.h>
+#endif
+
 #include "rwbase.h"
 #include "rwerror.h"
 #include "rwplg.h"
 #include "rwpipeline.h"
 #include "rwobjects.h"
 #include "rwengine.h"
+#include "rwanim.h"
 
 namespace rw {
 
 #define PLUGIN_ID 0
 
-int32 version = 0x36003;
-int32 build = 0xFFFF;
+RWTHREADLOCAL int32 version = 0x36003;
+RWTHREADLOCAL int32 build = 0xFFFF;
 #ifdef RW_PS2
 	int32 platform = PLATFORM_PS2;
 #elif RW_WDGL
@@ -30,6 +59,11 @@ int32 build = 0xFFFF;
 	int32 platform = PLATFORM_NULL;
 #endif
 bool32 streamAppendFrames = 0;
+bool32 streamSinglePass = 0;
+bool32 streamCheckSizes = 0;
+bool32 streamBorrowGeometry = 0;
+int32 streamLoadThreads = 0;
+int32 streamTextureThreads = 0;
 char *debugFile = nil;
 
 static Matrix identMat = {
@@ -39,6 +73,212 @@ static Matrix identMat = {
 	{ 0.0f, 0.0f, 0.0f }, 0
 };
 
+void
+StreamContext::getCurrent(void)
+{
+	this->version = rw::version;
+	this->build = rw::build;
+	this->texDict = TexDictionary::getCurrent();
+	this->uvAnimDict = currentUVAnimDictionary;
+}
+
+void
+StreamContext::setCurrent(void)
+{
+	rw::version = this->version;
+	rw::build = this->build;
+	TexDictionary::setCurrent(this->texDict);
+	currentUVAnimDictionary = this->uvAnimDict;
+}
+
+#ifndef RW_PS2
+struct JobQueue
+{
+	void (*func)(void *data, int32 i);
+	void *data;
+	int32 numJobs;
+	std::atomic<int32> next;
+	StreamContext context;	// of the calling thread
+	std::atomic<bool32> failed;
+	Error error;		// first one of a worker
+};
+
+static void
+jobWorker(JobQueue *q)
+{
+	int32 i;
+	while(i = q->next++, i < q->numJobs)
+		q->func(q->data, i);
+}
+
+// Jobs on other threads see the caller's stream state
+// and their errors are handed back to it.
+static void
+otherJobWorker(JobQueue *q)
+{
+	Error e;
+	q->context.setCurrent();
+	jobWorker(q);
+	getError(&e);
+	if(e.code && !q->failed.exchange(1))
+		q->error = e;
+}
+
+static void
+passJobError(JobQueue *q)
+{
+	Error e;
+	if(!q->failed)
+		return;
+	// caller's own error comes first
+	getError(&e);
+	setError(e.code ? &e : &q->error);
+}
+
+// Threads are kept around because some jobs run every frame.
+// Only one caller can use them at a time, others (e.g. loader
+// threads) start their own threads like before.
+struct JobPool
+{
+	std::mutex inUse;
+	std::mutex mutex;
+	std::condition_variable workCond;
+	std::condition_variable doneCond;
+	std::thread *threads;
+	int32 numThreads;
+	JobQueue *queue;	// nil when no work
+	int32 slots;		// threads that may still join
+	int32 busy;
+	uint32 generation;
+	bool32 quit;
+};
+
+// Never destroyed, workers may still be waiting at exit
+static JobPool*
+getJobPool(void)
+{
+	static JobPool *pool = new JobPool();
+	return pool;
+}
+
+static void
+poolWorker(void)
+{
+	JobPool *p = getJobPool();
+	JobQueue *q;
+	uint32 gen = 0;
+	std::unique_lock<std::mutex> lock(p->mutex);
+	for(;;){
+		while(!p->quit && (p->queue == nil || p->slots == 0 || p->generation == gen))
+			p->workCond.wait(lock);
+		if(p->quit)
+			return;
+		gen = p->generation;
+		q = p->queue;
+		p->slots--;
+		p->busy++;
+		lock.unlock();
+		otherJobWorker(q);
+		lock.lock();
+		if(--p->busy == 0)
+			p->doneCond.notify_all();
+	}
+}
+
+static void
+runPoolJobs(int32 numThreads, JobQueue *q)
+{
+	JobPool *p = getJobPool();
+	int32 i;
+	if(numThreads-1 > p->numThreads){
+		std::lock_guard<std::mutex> lock(p->mutex);
+		std::thread *threads = new std::thread[numThreads-1];
+		for(i = 0; i < p->numThreads; i++)
+			threads[i] = std::move(p->threads[i]);
+		for(; i < numThreads-1; i++)
+			threads[i] = std::thread(poolWorker);
+		delete[] p->threads;
+		p->threads = threads;
+		p->numThreads = numThreads-1;
+	}
+	{
+		std::lock_guard<std::mutex> lock(p->mutex);
+		p->queue = q;
+		p->slots = numThreads-1;
+		p->generation++;
+	}
+	p->workCond.notify_all();
+	jobWorker(q);
+	// no thread can pick up the queue after this
+	std::unique_lock<std::mutex> lock(p->mutex);
+	p->queue = nil;
+	while(p->busy)
+		p->doneCond.wait(lock);
+}
+
+static void
+runThreadJobs(int32 numThreads, JobQueue *q)
+{
+	int32 i;
+	std::thread *threads = new std::thread[numThreads-1];
+	for(i = 0; i < numThreads-1; i++)
+		threads[i] = std::thread(otherJobWorker, q);
+	jobWorker(q);
+	for(i = 0; i < numThreads-1; i++)
+		threads[i].join();
+	delete[] threads;
+}
+#endif
+
+void
+runJobs(int32 numThreads, int32 numJobs, void (*func)(void *data, int32 i), void *data)
+{
+	int32 i;
+#ifndef RW_PS2
+	if(numThreads > numJobs)
+		numThreads = numJobs;
+	if(numThreads > 1){
+		JobQueue q;
+		q.func = func;
+		q.data = data;
+		q.numJobs = numJobs;
+		q.next = 0;
+		q.context.getCurrent();
+		q.failed = 0;
+		JobPool *p = getJobPool();
+		if(p->inUse.try_lock()){
+			runPoolJobs(numThreads, &q);
+			p->inUse.unlock();
+		}else
+			runThreadJobs(numThreads, &q);
+		passJobError(&q);
+		return;
+	}
+#endif
+	for(i = 0; i < numJobs; i++)
+		func(data, i);
+}
+
+void
+stopJobThreads(void)
+{
+#ifndef RW_PS2
+	JobPool *p = getJobPool();
+	std::lock_guard<std::mutex> use(p->inUse);
+	{
+		std::lock_guard<std::mutex> lock(p->mutex);
+		p->quit = 1;
+	}
+	p->workCond.notify_all();
+	for(int32 i = 0; i < p->numThreads; i++)
+		p->threads[i].join();
+	delete[] p->threads;
+	p->threads = nil;
+	p->numThreads = 0;
+	p->quit = 0;
+#endif
+}
+
 // lazy implementation
 int
 strcmp_ci(const char *s1, const char *s2)
@@ -129,12 +369,71 @@ cross(const V3d &a, const V3d &b)
 	               a.x*b.y - a.y*b.x);
 }
 
+#ifdef RW_SSE2
+// 4 packed V3ds <-> x, y and z of each
+static inline void
+loadV3d4(const V3d *in, __m128 &x, __m128 &y, __m128 &z)
+{
+	__m128 a = _mm_loadu_ps(&in[0].x);	// x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(&in[1].y);	// y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(&in[2].z);	// z2 x3 y3 z3
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+	                   _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), c, _MM_SHUFFLE(3,0,2,0));
+}
+
+static inline void
+storeV3d4(V3d *out, __m128 x, __m128 y, __m128 z)
+{
+	__m128 a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y),
+	                          _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,1,0));
+	__m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)),
+	                          _mm_unpackhi_ps(x, y), _MM_SHUFFLE(1,0,2,0));
+	__m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)),
+	                          _mm_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+	_mm_storeu_ps(&out[0].x, a);
+	_mm_storeu_ps(&out[1].y, b);
+	_mm_storeu_ps(&out[2].z, c);
+}
+#endif
+
+// The SIMD versions do the same operations in the same
+// order as the scalar code, so the results are identical.
+// Four points at a time, all are loaded before any is stored
+// so out may be in.
 void
 V3d::transformPoints(V3d *out, const V3d *in, int32 n, const Matrix *m)
 {
-	int32 i;
+	int32 i = 0;
 	V3d tmp;
-	for(i = 0; i < n; i++){
+#ifdef RW_SSE2
+	__m128 rx = _mm_set1_ps(m->right.x), ry = _mm_set1_ps(m->right.y), rz = _mm_set1_ps(m->right.z);
+	__m128 ux = _mm_set1_ps(m->up.x), uy = _mm_set1_ps(m->up.y), uz = _mm_set1_ps(m->up.z);
+	__m128 ax = _mm_set1_ps(m->at.x), ay = _mm_set1_ps(m->at.y), az = _mm_set1_ps(m->at.z);
+	__m128 px = _mm_set1_ps(m->pos.x), py = _mm_set1_ps(m->pos.y), pz = _mm_set1_ps(m->pos.z);
+	__m128 x, y, z;
+	for(; i+4 <= n; i += 4){
+		loadV3d4(&in[i], x, y, z);
+		storeV3d4(&out[i],
+			_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, rx), _mm_mul_ps(y, ux)), _mm_mul_ps(z, ax)), px),
+			_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, ry), _mm_mul_ps(y, uy)), _mm_mul_ps(z, ay)), py),
+			_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, rz), _mm_mul_ps(y, uz)), _mm_mul_ps(z, az)), pz));
+	}
+#elif defined(RW_NEON)
+	for(; i+4 <= n; i += 4){
+		float32x4x3_t v = vld3q_f32(&in[i].x);
+		float32x4x3_t r;
+		for(int32 j = 0; j < 3; j++){
+			const float32 *col = &m->right.x + j;
+			r.val[j] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0], col[0]),
+				vmulq_n_f32(v.val[1], col[4])), vmulq_n_f32(v.val[2], col[8])),
+				vdupq_n_f32(col[12]));
+		}
+		vst3q_f32(&out[i].x, r);
+	}
+#endif
+	for(; i < n; i++){
 		tmp.x = in[i].x*m->right.x + in[i].y*m->up.x + in[i].z*m->at.x + m->pos.x;
 		tmp.y = in[i].x*m->right.y + in[i].y*m->up.y + in[i].z*m->at.y + m->pos.y;
 		tmp.z = in[i].x*m->right.z + in[i].y*m->up.z + in[i].z*m->at.z + m->pos.z;
@@ -142,6 +441,7 @@ V3d::transformPoints(V3d *out, const V3d *in, int32 n, const Matrix *m)
 	}
 }
 
+// Plain loop, four-wide SSE2 was slower than what the compiler makes of this
 void
 V3d::transformVectors(V3d *out, const V3d *in, int32 n, const Matrix *m)
 {
@@ -162,6 +462,33 @@ V3d::transformVectors(V3d *out, const V3d *in, int32 n, const Matrix *m)
 void
 RawMatrix::mult(RawMatrix *dst, RawMatrix *src1, RawMatrix *src2)
 {
+#ifdef RW_SSE2
+	__m128 r0 = _mm_loadu_ps(&src2->right.x);
+	__m128 r1 = _mm_loadu_ps(&src2->up.x);
+	__m128 r2 = _mm_loadu_ps(&src2->at.x);
+	__m128 r3 = _mm_loadu_ps(&src2->pos.x);
+	__m128 d[4];
+	const float32 *s = &src1->right.x;
+	for(int32 i = 0; i < 4; i++, s += 4)
+		d[i] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(s[0]), r0), _mm_mul_ps(_mm_set1_ps(s[1]), r1)),
+			_mm_mul_ps(_mm_set1_ps(s[2]), r2)), _mm_mul_ps(_mm_set1_ps(s[3]), r3));
+	for(int32 i = 0; i < 4; i++)
+		_mm_storeu_ps(&dst->right.x + 4*i, d[i]);
+#elif defined(RW_NEON)
+	float32x4_t r0 = vld1q_f32(&src2->right.x);
+	float32x4_t r1 = vld1q_f32(&src2->up.x);
+	float32x4_t r2 = vld1q_f32(&src2->at.x);
+	float32x4_t r3 = vld1q_f32(&src2->pos.x);
+	float32x4_t d[4];
+	const float32 *s = &src1->right.x;
+	for(int32 i = 0; i < 4; i++, s += 4)
+		d[i] = vaddq_f32(vaddq_f32(vaddq_f32(
+			vmulq_n_f32(r0, s[0]), vmulq_n_f32(r1, s[1])),
+			vmulq_n_f32(r2, s[2])), vmulq_n_f32(r3, s[3]));
+	for(int32 i = 0; i < 4; i++)
+		vst1q_f32(&dst->right.x + 4*i, d[i]);
+#else
 	dst->right.x = src1->right.x*src2->right.x + src1->right.y*src2->up.x + src1->right.z*src2->at.x + src1->rightw*src2->pos.x;
 	dst->right.y = src1->right.x*src2->right.y + src1->right.y*src2->up.y + src1->right.z*src2->at.y + src1->rightw*src2->pos.y;
 	dst->right.z = src1->right.x*src2->right.z + src1->right.y*src2->up.z + src1->right.z*src2->at.z + src1->rightw*src2->pos.z;
@@ -178,6 +505,7 @@ RawMatrix::mult(RawMatrix *dst, RawMatrix *src1, RawMatrix *src2)
 	dst->pos.y   = src1->pos.x*src2->right.y   + src1->pos.y*src2->up.y   + src1->pos.z*src2->at.y + src1->posw*src2->pos.y;
 	dst->pos.z   = src1->pos.x*src2->right.z   + src1->pos.y*src2->up.z   + src1->pos.z*src2->at.z + src1->posw*src2->pos.z;
 	dst->posw    = src1->pos.x*src2->rightw    + src1->pos.y*src2->upw    + src1->pos.z*src2->atw  + src1->posw*src2->posw;
+#endif
 }
 
 void
@@ -201,6 +529,40 @@ RawMatrix::transpose(RawMatrix *dst, RawMatrix *src)
 	dst->posw = src->posw;
 }
 
+// dst may be src
+void
+RawMatrix::transposeArray(RawMatrix *dst, RawMatrix *src, int32 n)
+{
+	int32 i;
+#ifdef RW_SSE2
+	for(i = 0; i < n; i++){
+		__m128 r = _mm_loadu_ps(&src[i].right.x);
+		__m128 u = _mm_loadu_ps(&src[i].up.x);
+		__m128 a = _mm_loadu_ps(&src[i].at.x);
+		__m128 p = _mm_loadu_ps(&src[i].pos.x);
+		_MM_TRANSPOSE4_PS(r, u, a, p);
+		_mm_storeu_ps(&dst[i].right.x, r);
+		_mm_storeu_ps(&dst[i].up.x, u);
+		_mm_storeu_ps(&dst[i].at.x, a);
+		_mm_storeu_ps(&dst[i].pos.x, p);
+	}
+#elif defined(RW_NEON)
+	for(i = 0; i < n; i++){
+		float32x4x4_t m = vld4q_f32(&src[i].right.x);
+		vst1q_f32(&dst[i].right.x, m.val[0]);
+		vst1q_f32(&dst[i].up.x, m.val[1]);
+		vst1q_f32(&dst[i].at.x, m.val[2]);
+		vst1q_f32(&dst[i].pos.x, m.val[3]);
+	}
+#else
+	RawMatrix tmp;
+	for(i = 0; i < n; i++){
+		transpose(&tmp, &src[i]);
+		dst[i] = tmp;
+	}
+#endif
+}
+
 void
 RawMatrix::setIdentity(RawMatrix *dst)
 {
@@ -239,10 +601,24 @@ Matrix::setIdentity(void)
 	*this = identMat;
 }
 
+static bool32
+isExactIdentity(const Matrix *m)
+{
+	return m->right.x == 1.0f && m->right.y == 0.0f && m->right.z == 0.0f &&
+	       m->up.x == 0.0f && m->up.y == 1.0f && m->up.z == 0.0f &&
+	       m->at.x == 0.0f && m->at.y == 0.0f && m->at.z == 1.0f &&
+	       m->pos.x == 0.0f && m->pos.y == 0.0f && m->pos.z == 0.0f;
+}
+
 void
 Matrix::optimize(Tolerance *tolerance)
 {
 	bool32 isnormal, isorthogonal, isidentity;
+	// common for streamed frames, no need to measure anything
+	if(isExactIdentity(this)){
+		flags |= TYPEORTHONORMAL|IDENTITY;
+		return;
+	}
 	if(tolerance == nil)
 		tolerance = &matrixDefaultTolerance;
 	isnormal = normalError() <= tolerance->normal;
@@ -262,6 +638,18 @@ Matrix::optimize(Tolerance *tolerance)
 		flags &= ~IDENTITY;
 }
 
+void
+Matrix::optimizeOrthonormal(Tolerance *tolerance)
+{
+	if(tolerance == nil)
+		tolerance = &matrixDefaultTolerance;
+	flags |= TYPEORTHONORMAL;
+	if(isExactIdentity(this) || identityError() <= tolerance->identity)
+		flags |= IDENTITY;
+	else
+		flags &= ~IDENTITY;
+}
+
 Matrix*
 Matrix::mult(Matrix *dst, const Matrix *src1, const Matrix *src2)
 {
@@ -379,8 +767,12 @@ Matrix::scale(V3d *scale, CombineOp op)
 	Matrix tmp;
 	Matrix scl = identMat;
 	scl.right.x = scale->x;
-	scl.right.y = scale->y;
-	scl.right.z = scale->z;
+	scl.up.y = scale->y;
+	scl.at.z = scale->z;
+	// still orthogonal but no longer the identity
+	scl.flags = TYPEORTHOGONAL;
+	if(fabs(scale->x) == 1.0f && fabs(scale->y) == 1.0f && fabs(scale->z) == 1.0f)
+		scl.flags |= TYPENORMAL;
 	switch(op){
 	case COMBINEREPLACE:
 		*this = scl;
@@ -461,9 +853,116 @@ Matrix::lookAt(const V3d &dir, const V3d &up)
 	this->flags = TYPEORTHONORMAL;
 }
 
-void
-Matrix::mult_(Matrix *dst, const Matrix *src1, const Matrix *src2)
+#ifdef RW_SSE2
+// The fourth float of a Matrix row is flags or padding.
+// Keep it out of the arithmetic (it may be a denormal)
+// and don't touch the destination's when storing.
+static inline __m128
+loadRow(const V3d *v, __m128 mask)
+{
+	return _mm_and_ps(_mm_loadu_ps(&v->x), mask);
+}
+
+static inline void
+storeRow(V3d *v, __m128 r)
+{
+	_mm_storel_pi((__m64*)&v->x, r);
+	_mm_store_ss(&v->z, _mm_movehl_ps(r, r));
+}
+
+static inline __m128
+xyzMask(void)
+{
+	return _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+}
+#elif defined(RW_NEON)
+static inline float32x4_t
+loadRow(const V3d *v)
+{
+	return vsetq_lane_f32(0.0f, vld1q_f32(&v->x), 3);
+}
+
+static inline void
+storeRow(V3d *v, float32x4_t r)
+{
+	vst1_f32(&v->x, vget_low_f32(r));
+	vst1q_lane_f32(&v->z, r, 2);
+}
+#endif
+
+#ifdef RW_SSE2
+struct MatrixRows
 {
+	__m128 r, u, a, p;
+};
+
+static inline void
+loadRows(MatrixRows *m, const Matrix *src, __m128 mask)
+{
+	m->r = loadRow(&src->right, mask);
+	m->u = loadRow(&src->up, mask);
+	m->a = loadRow(&src->at, mask);
+	m->p = loadRow(&src->pos, mask);
+}
+
+static inline void
+multRows(Matrix *dst, const Matrix *src1, const MatrixRows *m)
+{
+	const V3d *s[4] = { &src1->right, &src1->up, &src1->at, &src1->pos };
+	__m128 d[4];
+	for(int32 i = 0; i < 4; i++)
+		d[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(s[i]->x), m->r),
+			_mm_mul_ps(_mm_set1_ps(s[i]->y), m->u)), _mm_mul_ps(_mm_set1_ps(s[i]->z), m->a));
+	d[3] = _mm_add_ps(d[3], m->p);
+	storeRow(&dst->right, d[0]);
+	storeRow(&dst->up, d[1]);
+	storeRow(&dst->at, d[2]);
+	storeRow(&dst->pos, d[3]);
+}
+#elif defined(RW_NEON)
+struct MatrixRows
+{
+	float32x4_t r, u, a, p;
+};
+
+static inline void
+loadRows(MatrixRows *m, const Matrix *src)
+{
+	m->r = loadRow(&src->right);
+	m->u = loadRow(&src->up);
+	m->a = loadRow(&src->at);
+	m->p = loadRow(&src->pos);
+}
+
+static inline void
+multRows(Matrix *dst, const Matrix *src1, const MatrixRows *m)
+{
+	const V3d *s[4] = { &src1->right, &src1->up, &src1->at, &src1->pos };
+	float32x4_t d[4];
+	for(int32 i = 0; i < 4; i++)
+		d[i] = vaddq_f32(vaddq_f32(vmulq_n_f32(m->r, s[i]->x),
+			vmulq_n_f32(m->u, s[i]->y)), vmulq_n_f32(m->a, s[i]->z));
+	d[3] = vaddq_f32(d[3], m->p);
+	storeRow(&dst->right, d[0]);
+	storeRow(&dst->up, d[1]);
+	storeRow(&dst->at, d[2]);
+	storeRow(&dst->pos, d[3]);
+}
+#endif
+
+static inline void
+multMatrix(Matrix *dst, const Matrix *src1, const Matrix *src2)
+{
+#ifdef RW_SSE2
+	__m128 mask = xyzMask();
+	MatrixRows m;
+	loadRows(&m, src2, mask);
+	multRows(dst, src1, &m);
+#elif defined(RW_NEON)
+	MatrixRows m;
+	loadRows(&m, src2);
+	multRows(dst, src1, &m);
+#else
 	dst->right.x = src1->right.x*src2->right.x + src1->right.y*src2->up.x + src1->right.z*src2->at.x;
 	dst->right.y = src1->right.x*src2->right.y + src1->right.y*src2->up.y + src1->right.z*src2->at.y;
 	dst->right.z = src1->right.x*src2->right.z + src1->right.y*src2->up.z + src1->right.z*src2->at.z;
@@ -476,6 +975,95 @@ Matrix::mult_(Matrix *dst, const Matrix *src1, const Matrix *src2)
 	dst->pos.x   = src1->pos.x*src2->right.x   + src1->pos.y*src2->up.x   + src1->pos.z*src2->at.x + src2->pos.x;
 	dst->pos.y   = src1->pos.x*src2->right.y   + src1->pos.y*src2->up.y   + src1->pos.z*src2->at.y + src2->pos.y;
 	dst->pos.z   = src1->pos.x*src2->right.z   + src1->pos.y*src2->up.z   + src1->pos.z*src2->at.z + src2->pos.z;
+#endif
+}
+
+void
+Matrix::mult_(Matrix *dst, const Matrix *src1, const Matrix *src2)
+{
+	multMatrix(dst, src1, src2);
+}
+
+// The array versions don't look for identity matrices,
+// the flags are combined like in mult().
+void
+Matrix::multArray(Matrix *dst, const Matrix *src1, const Matrix *src2, int32 n)
+{
+	int32 i;
+#ifdef RW_SSE2
+	__m128 mask = xyzMask();
+	MatrixRows m;
+	for(i = 0; i < n; i++){
+		loadRows(&m, &src2[i], mask);
+		multRows(&dst[i], &src1[i], &m);
+		dst[i].flags = src1[i].flags & src2[i].flags;
+	}
+#elif defined(RW_NEON)
+	MatrixRows m;
+	for(i = 0; i < n; i++){
+		loadRows(&m, &src2[i]);
+		multRows(&dst[i], &src1[i], &m);
+		dst[i].flags = src1[i].flags & src2[i].flags;
+	}
+#else
+	for(i = 0; i < n; i++){
+		multMatrix(&dst[i], &src1[i], &src2[i]);
+		dst[i].flags = src1[i].flags & src2[i].flags;
+	}
+#endif
+}
+
+void
+Matrix::multArrayByOne(Matrix *dst, const Matrix *src1, const Matrix *src2, int32 n)
+{
+	int32 i;
+	uint32 flags = src2->flags;
+#ifdef RW_SSE2
+	__m128 mask = xyzMask();
+	MatrixRows m;
+	loadRows(&m, src2, mask);
+	for(i = 0; i < n; i++){
+		multRows(&dst[i], &src1[i], &m);
+		dst[i].flags = src1[i].flags & flags;
+	}
+#elif defined(RW_NEON)
+	MatrixRows m;
+	loadRows(&m, src2);
+	for(i = 0; i < n; i++){
+		multRows(&dst[i], &src1[i], &m);
+		dst[i].flags = src1[i].flags & flags;
+	}
+#else
+	Matrix m = *src2;
+	for(i = 0; i < n; i++){
+		multMatrix(&dst[i], &src1[i], &m);
+		dst[i].flags = src1[i].flags & flags;
+	}
+#endif
+}
+
+void
+Matrix::multHierarchy(Matrix *dst, const Matrix *local, const int32 *parents, int32 n, const Matrix *root)
+{
+	const Matrix *parent;
+	for(int32 i = 0; i < n; i++){
+		parent = parents[i] < 0 ? root : &dst[parents[i]];
+		if(parent == nil){
+			dst[i] = local[i];
+			continue;
+		}
+		multMatrix(&dst[i], parent, &local[i]);
+		dst[i].flags = parent->flags & local[i].flags;
+	}
+}
+
+// Unlike the multiplies this keeps the checks of invert(),
+// skipping them wouldn't save much next to invertGeneral.
+void
+Matrix::invertArray(Matrix *dst, const Matrix *src, int32 n)
+{
+	for(int32 i = 0; i < n; i++)
+		invert(&dst[i], &src[i]);
 }
 
 void
@@ -502,10 +1090,55 @@ Matrix::invertOrthonormal(Matrix *dst, const Matrix *src)
 	dst->flags = TYPEORTHONORMAL;
 }
 
+#ifdef RW_SSE2
+#define SHUF(v, x, y, z) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, z, y, x))
+static inline __m128
+crossRow(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(SHUF(a, 1,2,0), SHUF(b, 2,0,1)),
+	                  _mm_mul_ps(SHUF(a, 2,0,1), SHUF(b, 1,2,0)));
+}
+#undef SHUF
+#define SPLAT(v, i) _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+#endif
+
 Matrix*
 Matrix::invertGeneral(Matrix *dst, const Matrix *src)
 {
 	float32 det, invdet;
+	uint32 flags = src->flags;	// src may be dst
+#ifdef RW_SSE2
+	__m128 mask = xyzMask();
+	__m128 r = loadRow(&src->right, mask);
+	__m128 u = loadRow(&src->up, mask);
+	__m128 a = loadRow(&src->at, mask);
+	__m128 p = loadRow(&src->pos, mask);
+	// cofactors are the columns of the inverse
+	__m128 c0 = crossRow(u, a);
+	__m128 c1 = crossRow(a, r);
+	__m128 c2 = crossRow(r, u);
+	// same sum as below, only x is of interest
+	det = _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(_mm_mul_ss(u, c1), _mm_mul_ss(a, c2)), _mm_mul_ss(c0, r)));
+	invdet = 1.0;
+	if(det != 0.0f)
+		invdet = 1.0f/det;
+	__m128 c3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	__m128 inv = _mm_set1_ps(invdet);
+	c0 = _mm_mul_ps(c0, inv);
+	c1 = _mm_mul_ps(c1, inv);
+	c2 = _mm_mul_ps(c2, inv);
+	p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(SPLAT(p, 0), c0), _mm_mul_ps(SPLAT(p, 1), c1)), _mm_mul_ps(SPLAT(p, 2), c2));
+	p = _mm_xor_ps(p, _mm_set1_ps(-0.0f));
+	storeRow(&dst->right, c0);
+	storeRow(&dst->up, c1);
+	storeRow(&dst->at, c2);
+	storeRow(&dst->pos, p);
+	// Only orthonormal survives inversion, the rows of
+	// an inverted scaled rotation aren't orthogonal.
+	dst->flags = (flags & TYPEMASK) == TYPEORTHONORMAL ? TYPEORTHONORMAL : 0;
+	return dst;
+#else
 	// calculate a few cofactors
 	dst->right.x = src->up.y*src->at.z - src->up.z*src->at.y;
 	dst->right.y = src->at.y*src->right.z - src->at.z*src->right.y;
@@ -527,8 +1160,11 @@ Matrix::invertGeneral(Matrix *dst, const Matrix *src)
 	dst->pos.x = -(src->pos.x*dst->right.x + src->pos.y*dst->up.x + src->pos.z*dst->at.x);
 	dst->pos.y = -(src->pos.x*dst->right.y + src->pos.y*dst->up.y + src->pos.z*dst->at.y);
 	dst->pos.z = -(src->pos.x*dst->right.z + src->pos.y*dst->up.z + src->pos.z*dst->at.z);
-	dst->flags &= ~IDENTITY;
+	// Only orthonormal survives inversion, the rows of
+	// an inverted scaled rotation aren't orthogonal.
+	dst->flags = (flags & TYPEMASK) == TYPEORTHONORMAL ? TYPEORTHONORMAL : 0;
 	return dst;
+#endif
 }
 
 void
@@ -848,6 +1484,16 @@ StreamMemory::open(uint8 *data, uint32 length, uint32 capacity)
 	return this;
 }
 
+uint8*
+StreamMemory::getData(uint32 len)
+{
+	if(this->eof() || len > this->length - this->position)
+		return nil;
+	uint8 *p = &this->data[this->position];
+	this->position += len;
+	return p;
+}
+
 uint32
 StreamMemory::getLength(void)
 {
@@ -855,8 +1501,113 @@ StreamMemory::getLength(void)
 }
 
 
+StreamMapped*
+StreamMapped::open(const char *path)
+{
+	assert(this->base == nil);
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nil,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nil);
+	if(file == INVALID_HANDLE_VALUE){
+		RWERROR((ERR_FILE, path));
+		return nil;
+	}
+	this->size = GetFileSize(file, nil);
+	if(this->size){
+		HANDLE mapping = CreateFileMappingA(file, nil, PAGE_READONLY, 0, 0, nil);
+		if(mapping)
+			this->base = (uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if(this->base == nil){
+			if(mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			RWERROR((ERR_FILE, path));
+			return nil;
+		}
+		this->handle = mapping;
+	}
+	CloseHandle(file);
+#elif defined(RW_PS2)
+	// no mmap here, just read the whole file
+	FILE *file = fopen(path, "rb");
+	if(file == nil){
+		RWERROR((ERR_FILE, path));
+		return nil;
+	}
+	fseek(file, 0, SEEK_END);
+	this->size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if(this->size){
+		this->base = rwNewT(uint8, this->size, MEMDUR_EVENT);
+		if(fread(this->base, 1, this->size, file) != this->size){
+			fclose(file);
+			rwFree(this->base);
+			this->base = nil;
+			this->size = 0;
+			RWERROR((ERR_FILE, path));
+			return nil;
+		}
+	}
+	fclose(file);
+#else
+	struct stat st;
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0){
+		RWERROR((ERR_FILE, path));
+		return nil;
+	}
+	if(fstat(fd, &st) < 0){
+		::close(fd);
+		RWERROR((ERR_FILE, path));
+		return nil;
+	}
+	this->size = st.st_size;
+	if(this->size){
+		void *p = mmap(nil, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED){
+			::close(fd);
+			RWERROR((ERR_FILE, path));
+			return nil;
+		}
+		// we mostly walk chunks front to back
+		madvise(p, this->size, MADV_SEQUENTIAL);
+		this->base = (uint8*)p;
+	}
+	::close(fd);
+#endif
+	StreamMemory::open(this->base, this->size);
+	return this;
+}
+
+void
+StreamMapped::close(void)
+{
+	if(this->base){
+#ifdef _WIN32
+		UnmapViewOfFile(this->base);
+		CloseHandle((HANDLE)this->handle);
+#elif defined(RW_PS2)
+		rwFree(this->base);
+#else
+		munmap(this->base, this->size);
+#endif
+	}
+	this->base = nil;
+	this->size = 0;
+	this->handle = nil;
+	StreamMemory::open(nil, 0);
+}
+
+uint32
+StreamMapped::write(const void*, uint32)
+{
+	// read only
+	return 0;
+}
+
+
 StreamFile*
-StreamFile::open(const char *path, const char *mode)
+StreamFile::open(const char *path, const char *mode, uint32 bufferSize)
 {
 	assert(this->file == nil);
 	this->file = fopen(path, mode);
@@ -864,6 +1615,19 @@ StreamFile::open(const char *path, const char *mode)
 		RWERROR((ERR_FILE, path));
 		return nil;
 	}
+	this->buffer = nil;
+	if(bufferSize){
+		this->buffer = rwNewT(uint8, bufferSize, MEMDUR_EVENT);
+		this->bufferSize = bufferSize;
+		this->bufferStart = ftell(this->file);
+		this->bufferPos = 0;
+		this->bufferFill = 0;
+		this->filePos = this->bufferStart;
+		this->bufferDirty = 0;
+		this->bufferEOF = 0;
+		// we're doing the buffering ourselves
+		setvbuf(this->file, nil, _IONBF, 0);
+	}
 	return this;
 }
 
@@ -871,37 +1635,160 @@ void
 StreamFile::close(void)
 {
 	assert(this->file);
+	if(this->buffer){
+		this->flushBuffer();
+		rwFree(this->buffer);
+		this->buffer = nil;
+	}
 	fclose(this->file);
 	this->file = nil;
 }
 
+void
+StreamFile::seekFile(uint32 pos)
+{
+	if(this->filePos != pos){
+		fseek(this->file, pos, SEEK_SET);
+		this->filePos = pos;
+	}
+}
+
+// Write out pending data, the buffer contents stay valid
+void
+StreamFile::flushBuffer(void)
+{
+	if(!this->bufferDirty)
+		return;
+	this->seekFile(this->bufferStart);
+	this->filePos += (uint32)fwrite(this->buffer, 1, this->bufferFill, this->file);
+	this->bufferDirty = 0;
+}
+
 uint32
 StreamFile::write(const void *data, uint32 length)
 {
-	return (uint32)fwrite(data, length, 1, this->file);
+	if(this->buffer == nil)
+		return (uint32)fwrite(data, 1, length, this->file);
+
+	const uint8 *src = (const uint8*)data;
+	uint32 done = 0;
+	while(length > 0){
+		if(this->bufferPos == this->bufferSize){
+			this->flushBuffer();
+			this->bufferStart += this->bufferPos;
+			this->bufferPos = 0;
+			this->bufferFill = 0;
+		}
+		// don't bother copying big blocks
+		if(this->bufferFill == 0 && length >= this->bufferSize){
+			this->seekFile(this->bufferStart);
+			uint32 n = (uint32)fwrite(src, 1, length, this->file);
+			this->filePos += n;
+			this->bufferStart += n;
+			return done + n;
+		}
+		uint32 n = this->bufferSize - this->bufferPos;
+		if(n > length)
+			n = length;
+		memcpy(&this->buffer[this->bufferPos], src, n);
+		this->bufferPos += n;
+		if(this->bufferPos > this->bufferFill)
+			this->bufferFill = this->bufferPos;
+		this->bufferDirty = 1;
+		src += n;
+		length -= n;
+		done += n;
+	}
+	return done;
 }
 
 uint32
 StreamFile::read(void *data, uint32 length)
 {
-	return (uint32)fread(data, length, 1, this->file);
+	if(this->buffer == nil)
+		return (uint32)fread(data, 1, length, this->file);
+
+	uint8 *dst = (uint8*)data;
+	uint32 done = 0;
+	while(length > 0){
+		if(this->bufferPos == this->bufferFill){
+			// buffer used up, get the next piece of the file
+			uint32 pos = this->bufferStart + this->bufferPos;
+			this->flushBuffer();
+			this->seekFile(pos);
+			this->bufferStart = pos;
+			this->bufferPos = 0;
+			this->bufferFill = 0;
+			if(length >= this->bufferSize){
+				uint32 n = (uint32)fread(dst, 1, length, this->file);
+				this->filePos += n;
+				this->bufferStart += n;
+				if(n != length)
+					this->bufferEOF = 1;
+				return done + n;
+			}
+			this->bufferFill = (uint32)fread(this->buffer, 1, this->bufferSize, this->file);
+			this->filePos += this->bufferFill;
+			if(this->bufferFill == 0){
+				this->bufferEOF = 1;
+				return done;
+			}
+		}
+		uint32 n = this->bufferFill - this->bufferPos;
+		if(n > length)
+			n = length;
+		memcpy(dst, &this->buffer[this->bufferPos], n);
+		this->bufferPos += n;
+		dst += n;
+		length -= n;
+		done += n;
+	}
+	return done;
 }
 
 void
 StreamFile::seek(int32 offset, int32 whence)
 {
-	fseek(this->file, offset, whence);
+	if(this->buffer == nil){
+		fseek(this->file, offset, whence);
+		return;
+	}
+
+	this->bufferEOF = 0;
+	uint32 pos;
+	if(whence == 0)
+		pos = offset;
+	else if(whence == 1)
+		pos = this->bufferStart + this->bufferPos + offset;
+	else{
+		this->flushBuffer();
+		fseek(this->file, offset, whence);
+		this->filePos = pos = ftell(this->file);
+	}
+	// stay inside the buffer if we can
+	if(pos >= this->bufferStart && pos <= this->bufferStart + this->bufferFill){
+		this->bufferPos = pos - this->bufferStart;
+		return;
+	}
+	this->flushBuffer();
+	this->bufferStart = pos;
+	this->bufferPos = 0;
+	this->bufferFill = 0;
 }
 
 uint32
 StreamFile::tell(void)
 {
+	if(this->buffer)
+		return this->bufferStart + this->bufferPos;
 	return ftell(this->file);
 }
 
 bool
 StreamFile::eof(void)
 {
+	if(this->buffer)
+		return this->bufferEOF;
 	return ( feof(this->file) != 0 );
 }
 
@@ -916,6 +1803,28 @@ writeChunkHeader(Stream *s, int32 type, int32 size)
 	return true;
 }
 
+// Returns the start of the chunk data for endChunk
+uint32
+beginChunk(Stream *s, int32 type, int32 size)
+{
+	writeChunkHeader(s, type, size);
+	return s->tell();
+}
+
+void
+endChunk(Stream *s, uint32 start, int32 size)
+{
+	if(!streamSinglePass)
+		return;
+	uint32 end = s->tell();
+	int32 length = end - start;
+	if(streamCheckSizes && length != size)
+		RWERROR((ERR_CHUNKSIZE, start-12, length, size));
+	s->seek(start-8, 0);
+	s->writeI32(length);
+	s->seek(end, 0);
+}
+
 bool
 readChunkHeaderInfo(Stream *s, ChunkHeaderInfo *header)
 {
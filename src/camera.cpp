@@ -18,6 +18,7 @@ void
 defaultBeginUpdateCB(Camera *cam)
 {
 	engine->currentCamera = cam;
+	resetFrameMemory();
 	Frame::syncDirty();
 	engine->device.beginUpdate(cam);
 }
@@ -465,7 +466,8 @@ bool
 Camera::streamWrite(Stream *stream)
 {
 	CameraChunkData buf;
-	writeChunkHeader(stream, ID_CAMERA, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_CAMERA, size);
 	writeChunkHeader(stream, ID_STRUCT, sizeof(CameraChunkData));
 	buf.viewWindow = this->viewWindow;
 	buf.viewOffset = this->viewOffset;
@@ -475,6 +477,7 @@ Camera::streamWrite(Stream *stream)
 	buf.projection = this->projection;
 	stream->write(&buf, sizeof(CameraChunkData));
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
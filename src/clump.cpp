@@ -72,7 +72,7 @@ Clump::destroy(void)
 Clump*
 Clump::streamRead(Stream *stream)
 {
-	uint32 length, version;
+	uint32 length, version, listEnd;
 	int32 buf[3];
 	Clump *clump;
 	int32 numGeometries;
@@ -109,10 +109,11 @@ Clump::streamRead(Stream *stream)
 	numGeometries = 0;
 	geometryList = nil;
 	if(version >= 0x30400){
-		if(!findChunk(stream, ID_GEOMETRYLIST, nil, nil)){
+		if(!findChunk(stream, ID_GEOMETRYLIST, &length, nil)){
 			RWERROR((ERR_CHUNK, "GEOMETRYLIST"));
 			goto fail;
 		}
+		listEnd = stream->tell() + length;
 		if(!findChunk(stream, ID_STRUCT, nil, nil)){
 			RWERROR((ERR_CHUNK, "STRUCT"));
 			goto fail;
@@ -127,15 +128,9 @@ Clump::streamRead(Stream *stream)
 			}
 			memset(geometryList, 0, sz);
 		}
-		for(int32 i = 0; i < numGeometries; i++){
-			if(!findChunk(stream, ID_GEOMETRY, nil, nil)){
-				RWERROR((ERR_CHUNK, "GEOMETRY"));
-				goto failgeo;
-			}
-			geometryList[i] = Geometry::streamRead(stream);
-			if(geometryList[i] == nil)
-				goto failgeo;
-		}
+		if(!Geometry::streamReadList(stream, listEnd - stream->tell(),
+		                             geometryList, numGeometries))
+			goto failgeo;
 	}
 
 	// Atomics
@@ -212,15 +207,15 @@ fail:
 bool
 Clump::streamWrite(Stream *stream)
 {
-	int size = this->streamGetSize();
-	writeChunkHeader(stream, ID_CLUMP, size);
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_CLUMP, size);
 	int32 numAtomics = this->countAtomics();
 	int32 numLights = this->countLights();
 	int32 numCameras = this->countCameras();
 	int buf[3] = { numAtomics, numLights, numCameras };
-	size = version > 0x33000 ? 12 : 4;
-	writeChunkHeader(stream, ID_STRUCT, size);
-	stream->write(buf, size);
+	int structsize = version > 0x33000 ? 12 : 4;
+	writeChunkHeader(stream, ID_STRUCT, structsize);
+	stream->write(buf, structsize);
 
 	FrameList_ frmlst;
 	frmlst.numFrames = this->getFrame()->count();
@@ -229,14 +224,18 @@ Clump::streamWrite(Stream *stream)
 	frmlst.streamWrite(stream);
 
 	if(rw::version >= 0x30400){
-		size = 12+4;
-		FORLIST(lnk, this->atomics)
-			size += 12 + Atomic::fromClump(lnk)->geometry->streamGetSize();
-		writeChunkHeader(stream, ID_GEOMETRYLIST, size);
+		int32 geosize = 0;
+		if(needChunkSize()){
+			geosize = 12+4;
+			FORLIST(lnk, this->atomics)
+				geosize += 12 + Atomic::fromClump(lnk)->geometry->streamGetSize();
+		}
+		uint32 geostart = beginChunk(stream, ID_GEOMETRYLIST, geosize);
 		writeChunkHeader(stream, ID_STRUCT, 4);
 		stream->writeI32(numAtomics);	// same as numGeometries
 		FORLIST(lnk, this->atomics)
 			Atomic::fromClump(lnk)->geometry->streamWrite(stream);
+		endChunk(stream, geostart, geosize);
 	}
 
 	FORLIST(lnk, this->atomics)
@@ -265,6 +264,7 @@ Clump::streamWrite(Stream *stream)
 	rwFree(frmlst.frames);
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
@@ -333,10 +333,24 @@ worldAtomicSync(ObjectWithFrame *obj)
 	atomic->originalSync(obj);
 }
 
+static ObjectWithFrame::Sync
+worldAtomicSyncForwardsTo(ObjectWithFrame *obj)
+{
+	return ((Atomic*)obj)->originalSync;
+}
+
+// Only flags the world bounding sphere, safe to do in parallel
+void
+Atomic::registerModule(void)
+{
+	ObjectWithFrame::registerThreadSafeSync(atomicSync);
+	ObjectWithFrame::registerThreadSafeSync(worldAtomicSync, worldAtomicSyncForwardsTo);
+}
+
 Atomic*
 Atomic::create(void)
 {
-	Atomic *atomic = (Atomic*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_ATOMIC);
+	Atomic *atomic = (Atomic*)objPoolAlloc(OBJPOOL_ATOMIC, s_plglist.size, MEMDUR_EVENT | ID_ATOMIC);
 	if(atomic == nil){
 		RWERROR((ERR_ALLOC, s_plglist.size));
 		return nil;
@@ -390,7 +404,7 @@ Atomic::destroy(void)
 	if(this->clump)
 		this->inClump.remove();
 	this->setFrame(nil);
-	rwFree(this);
+	objPoolFree(OBJPOOL_ATOMIC, this);
 }
 
 void
@@ -435,7 +449,7 @@ Atomic::getWorldBoundingSphere(void)
 	return s;
 }
 
-static uint32 atomicRights[2];
+static RWTHREADLOCAL uint32 atomicRights[2];
 
 Atomic*
 Atomic::streamReadClump(Stream *stream,
@@ -486,7 +500,8 @@ Atomic::streamWriteClump(Stream *stream, FrameList_ *frmlst)
 	Clump *c = this->clump;
 	if(c == nil)
 		return false;
-	writeChunkHeader(stream, ID_ATOMIC, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_ATOMIC, size);
 	writeChunkHeader(stream, ID_STRUCT, rw::version < 0x30400 ? 12 : 16);
 	buf[0] = findPointer(this->getFrame(), (void**)frmlst->frames, frmlst->numFrames);
 
@@ -508,6 +523,7 @@ Atomic::streamWriteClump(Stream *stream, FrameList_ *frmlst)
 	}
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
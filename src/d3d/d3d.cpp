@@ -190,7 +190,7 @@ createIndexBuffer(uint32 length)
 	d3ddevice->CreateIndexBuffer(length, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, &ibuf, 0);
 	return ibuf;
 #else
-	return rwNewT(uint8, length, MEMDUR_EVENT | ID_DRIVER);
+	return rwNewAligned(length, 16, MEMDUR_EVENT | ID_DRIVER);
 #endif
 }
 
@@ -233,7 +233,7 @@ createVertexBuffer(uint32 length, uint32 fvf, int32 pool)
 #else
 	(void)fvf;
 	(void)pool;
-	return rwNewT(uint8, length, MEMDUR_EVENT | ID_DRIVER);
+	return rwNewAligned(length, 16, MEMDUR_EVENT | ID_DRIVER);
 #endif
 }
 
@@ -285,10 +285,11 @@ createTexture(int32 width, int32 height, int32 numlevels, uint32 format)
 		h /= 2;
 		if(h == 0) h = 1;
 	}
-	uint8 *data = (uint8*)rwNew(sizeof(RasterLevels)+sizeof(RasterLevels::Level)*(numlevels-1)+size,
-		MEMDUR_EVENT | ID_DRIVER);
+	// keep the texels 16 byte aligned
+	int32 hdrsz = (sizeof(RasterLevels)+sizeof(RasterLevels::Level)*(numlevels-1) + 0xF) & ~0xF;
+	uint8 *data = (uint8*)rwNewAligned(hdrsz+size, 16, MEMDUR_EVENT | ID_DRIVER);
 	RasterLevels *levels = (RasterLevels*)data;
-	data += sizeof(RasterLevels)+sizeof(RasterLevels::Level)*(numlevels-1);
+	data += hdrsz;
 	levels->numlevels = numlevels;
 	levels->format = format;
 	w = width;
@@ -342,7 +343,7 @@ deleteObject(void *object)
 	IUnknown *unk = (IUnknown*)object;
 	unk->Release();
 #else
-	rwFree(object);
+	rwFreeAligned(object);
 #endif
 }
 
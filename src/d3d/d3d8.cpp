@@ -115,9 +115,13 @@ readNativeData(Stream *stream, int32, void *object, int32, int32)
 	header->platform = PLATFORM_D3D8;
 
 	int32 size = stream->readI32();
-	uint8 *data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_GEOMETRY);
-	stream->read(data, size);
-	uint8 *p = data;
+	uint8 *data = nil;
+	uint8 *p = stream->getData(size);
+	if(p == nil){
+		data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_GEOMETRY);
+		stream->read(data, size);
+		p = data;
+	}
 	header->serialNumber = *(uint16*)p; p += 2;
 	header->numMeshes = *(uint16*)p; p += 2;
 	header->inst = rwNewT(InstanceData, header->numMeshes, MEMDUR_EVENT | ID_GEOMETRY);
@@ -437,6 +441,7 @@ readAsImage(Stream *stream, int32 width, int32 height, int32 depth, int32 format
 	uint8 palette[256*4];
 	int32 pallen = 0;
 	uint8 *data = nil;
+	uint8 *texels = nil;
 
 	Image *img = Image::create(width, height, 32);
 	img->allocate();
@@ -456,14 +461,18 @@ readAsImage(Stream *stream, int32 width, int32 height, int32 depth, int32 format
 	for(int32 i = 0; i < numLevels; i++){
 		uint32 size = stream->readU32();
 		if(i == 0){
-			data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_IMAGE);
-			stream->read(data, size);
+			texels = stream->getData(size);
+			if(texels == nil){
+				data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_IMAGE);
+				stream->read(data, size);
+				texels = data;
+			}
 		}else
 			stream->seek(size);
 	}
 
 	if(format & (Raster::PAL4 | Raster::PAL8)){
-		uint8 *idx = data;
+		uint8 *idx = texels;
 		uint8 *pixels = img->pixels;
 		for(int y = 0; y < img->height; y++){
 			uint8 *line = pixels;
@@ -71,7 +71,7 @@ createVertexDeclaration(VertexElement *elements)
 	VertexElement *e = (VertexElement*)elements;
 	while(e[n++].stream != 0xFF)
 		;
-	e = rwNewT(VertexElement, n, MEMDUR_EVENT | ID_DRIVER);
+	e = (VertexElement*)rwNewAligned(n*sizeof(VertexElement), 16, MEMDUR_EVENT | ID_DRIVER);
 	memcpy(e, elements, n*sizeof(VertexElement));
 	return e;
 #endif
@@ -135,9 +135,13 @@ readNativeData(Stream *stream, int32, void *object, int32, int32)
 	header->platform = PLATFORM_D3D9;
 
 	int32 size = stream->readI32();
-	uint8 *data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_GEOMETRY);
-	stream->read(data, size);
-	uint8 *p = data;
+	uint8 *data = nil;
+	uint8 *p = stream->getData(size);
+	if(p == nil){
+		data = rwNewT(uint8, size, MEMDUR_FUNCTION | ID_GEOMETRY);
+		stream->read(data, size);
+		p = data;
+	}
 	header->serialNumber = *(uint32*)p; p += 4;
 	header->numMeshes = *(uint32*)p; p += 4;
 	header->indexBuffer = nil; p += 4;
@@ -57,7 +57,7 @@ destroyNativeData(void *object, int32, int32)
 	InstanceDataHeader *header =
 		(InstanceDataHeader*)geometry->instData;
 	geometry->instData = nil;
-	rwFree(header->vertexBuffer);
+	rwFreeAligned(header->vertexBuffer);
 	rwFree(header->begin);
 	rwFree(header->data);
 	rwFree(header);
@@ -119,7 +119,7 @@ readNativeData(Stream *stream, int32, void *object, int32, int32)
 	}
 	header->end = inst;
 
-	header->vertexBuffer = rwNewT(uint8, header->stride*header->numVertices, MEMDUR_EVENT | ID_GEOMETRY);
+	header->vertexBuffer = rwNewAligned(header->stride*header->numVertices, 16, MEMDUR_EVENT | ID_GEOMETRY);
 	stream->read(header->vertexBuffer, header->stride*header->numVertices);
 	return stream;
 }
@@ -309,7 +309,7 @@ defaultInstanceCB(Geometry *geo, InstanceDataHeader *header)
 	if(*vertexFmt == 0)
 		*vertexFmt = makeVertexFmt(geo->flags, geo->numTexCoordSets);
 	header->stride = getVertexFmtStride(*vertexFmt);
-	header->vertexBuffer = rwNewT(uint8, header->stride*header->numVertices, MEMDUR_EVENT | ID_GEOMETRY);
+	header->vertexBuffer = rwNewAligned(header->stride*header->numVertices, 16, MEMDUR_EVENT | ID_GEOMETRY);
 	uint8 *dst = (uint8*)header->vertexBuffer;
 
 	uint32 fmt = *vertexFmt;
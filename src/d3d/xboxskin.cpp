@@ -60,7 +60,7 @@ readNativeSkin(Stream *stream, int32, void *object, int32 offset)
 	stream->seek(4);	// skip pointer to vertexBuffer
 	natskin->stride = stream->readI32();
 	int32 size = geometry->numVertices*natskin->stride;
-	natskin->vertexBuffer = rwNewT(uint8, size, MEMDUR_EVENT | ID_SKIN);
+	natskin->vertexBuffer = rwNewAligned(size, 16, MEMDUR_EVENT | ID_SKIN);
 	stream->read(natskin->vertexBuffer, size);
 	stream->read(skin->inverseMatrices, skin->numBones*64);
 
@@ -129,7 +129,7 @@ skinInstanceCB(Geometry *geo, InstanceDataHeader *header)
 	}
 
 	natskin->stride = 3*skin->numWeights;
-	uint8 *vbuf = rwNewT(uint8, header->numVertices*natskin->stride, MEMDUR_EVENT | ID_SKIN);
+	uint8 *vbuf = (uint8*)rwNewAligned(header->numVertices*natskin->stride, 16, MEMDUR_EVENT | ID_SKIN);
 	natskin->vertexBuffer = vbuf;
 
 	int32 w[4];
@@ -209,7 +209,7 @@ skinUninstanceCB(Geometry *geo, InstanceDataHeader *header)
 		}
 	}
 
-	rwFree(natskin->vertexBuffer);
+	rwFreeAligned(natskin->vertexBuffer);
 	rwFree(natskin);
 }
 
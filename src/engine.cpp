@@ -40,7 +40,7 @@ void *realloc_h(void *p, size_t sz, uint32 hint) { return realloc(p, sz); }
 void *mustmalloc_h(size_t sz, uint32 hint)
 {
 	void *ret;
-	ret = rwMalloc(sz, hint);
+	ret = Engine::memfuncs.rwmalloc(sz, hint);
 	if(ret || sz == 0)
 		return ret;
 	fprintf(stderr, "Error: out of memory\n");
@@ -50,7 +50,39 @@ void *mustmalloc_h(size_t sz, uint32 hint)
 void *mustrealloc_h(void *p, size_t sz, uint32 hint)
 {
 	void *ret;
-	ret = rwRealloc(p, sz, hint);
+	ret = Engine::memfuncs.rwrealloc(p, sz, hint);
+	if(ret || sz == 0)
+		return ret;
+	fprintf(stderr, "Error: out of memory\n");
+	exit(1);
+	return nil;
+}
+
+// Keep the pointer rwmalloc returned in front of the block
+void *mallocaligned_h(size_t sz, uint32 align, uint32 hint)
+{
+	uint8 *p;
+	void **pp;
+	if(sz == 0)
+		return nil;
+	if(align < sizeof(void*))
+		align = sizeof(void*);
+	p = (uint8*)Engine::memfuncs.rwmalloc(sz + align + sizeof(void*), hint);
+	if(p == nil)
+		return nil;
+	pp = (void**)(((uintptr)p + sizeof(void*) + align) & ~(uintptr)(align-1));
+	pp[-1] = p;
+	return pp;
+}
+void freealigned_h(void *p)
+{
+	if(p)
+		Engine::memfuncs.rwfree(((void**)p)[-1]);
+}
+void *mustmallocAligned(size_t sz, uint32 align, uint32 hint)
+{
+	void *ret;
+	ret = Engine::memfuncs.rwmallocaligned(sz, align, hint);
 	if(ret || sz == 0)
 		return ret;
 	fprintf(stderr, "Error: out of memory\n");
@@ -60,19 +92,28 @@ void *mustrealloc_h(void *p, size_t sz, uint32 hint)
 
 // This function mainly registers engine plugins
 bool32
-Engine::init(void)
+Engine::init(MemoryFunctions *memfuncs)
 {
 	if(engine || Engine::state != Dead){
 		RWERROR((ERR_ENGINEINIT));
 		return 0;
 	}
 
-	// TODO: make this an argument
-	memfuncs.rwmalloc = malloc_h;
-	memfuncs.rwrealloc = realloc_h;
-	memfuncs.rwfree = free;
-	memfuncs.rwmustmalloc = mustmalloc_h;
-	memfuncs.rwmustrealloc = mustrealloc_h;
+	if(memfuncs)
+		Engine::memfuncs = *memfuncs;
+	else{
+		Engine::memfuncs.rwmalloc = malloc_h;
+		Engine::memfuncs.rwrealloc = realloc_h;
+		Engine::memfuncs.rwfree = free;
+		Engine::memfuncs.rwmustmalloc = mustmalloc_h;
+		Engine::memfuncs.rwmustrealloc = mustrealloc_h;
+		Engine::memfuncs.rwmallocaligned = mallocaligned_h;
+		Engine::memfuncs.rwfreealigned = freealigned_h;
+	}
+	if(Engine::memfuncs.rwmallocaligned == nil){
+		Engine::memfuncs.rwmallocaligned = mallocaligned_h;
+		Engine::memfuncs.rwfreealigned = freealigned_h;
+	}
 
 	PluginList init = { sizeof(Driver), sizeof(Driver), nil, nil };
 	for(uint i = 0; i < NUM_PLATFORMS; i++)
@@ -81,9 +122,24 @@ Engine::init(void)
 	Engine::s_plglist.defaultSize = sizeof(Engine);
 	Engine::s_plglist.first = nil;
 	Engine::s_plglist.last = nil;
+	Engine::s_plglist.hotReserve = 0;
+	Engine::s_plglist.hotEnd = 0;
+	Engine::s_plglist.coldStart = 0;
+	Engine::s_plglist.table = nil;
+	Engine::s_plglist.ctors = nil;
+	Engine::s_plglist.numCtors = 0;
+	Engine::s_plglist.numDtors = 0;
+	Engine::s_plglist.numCopies = 0;
+
+	// room for the hot plugins we have
+	Geometry::s_plglist.reserveHot(sizeof(void*));	// Skin
+	Atomic::s_plglist.reserveHot(2*sizeof(void*));	// Skin, MatFX
+	Material::s_plglist.reserveHot(sizeof(void*));	// MatFX
 
 	// core plugin attach here
 	Frame::registerModule();
+	Atomic::registerModule();
+	Light::registerModule();
 	Texture::registerModule();
 
 	// driver plugin attach
@@ -175,6 +231,10 @@ void
 Engine::term(void)
 {
 	// TODO
+	objPoolRelease();
+	PluginList::freeAll();
+	if(memfuncs.rwfree == trackingMemoryFunctions.rwfree)
+		printLiveBlocks(1);
 	Engine::state = Dead;
 }
 
@@ -182,9 +242,12 @@ void
 Engine::close(void)
 {
 	// TODO
+	stopJobThreads();
 	for(uint i = 0; i < NUM_PLATFORMS; i++)
 		rwFree(rw::engine->driver[i]);
 	rwFree(engine);
+	if(memfuncs.rwfree == trackingMemoryFunctions.rwfree)
+		printLiveBlocks(0);
 	Engine::state = Initialized;
 }
 
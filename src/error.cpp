@@ -6,7 +6,7 @@
 
 namespace rw {
 
-static Error error;
+static RWTHREADLOCAL Error error;
 
 void
 setError(Error *e)
@@ -36,7 +36,7 @@ char*
 dbgsprint(uint32 code, ...)
 {
 	va_list ap;
-	static char strbuf[512];
+	static RWTHREADLOCAL char strbuf[512];
 
 	if(code & 0x80000000)
 		code &= ~0x80000000;
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cassert>
 
 #include "rwbase.h"
 #include "rwerror.h"
@@ -8,10 +9,28 @@
 #include "rwobjects.h"
 #include "rwengine.h"
 
+#ifndef RW_PS2
+#include <mutex>
+#endif
+
 #define PLUGIN_ID ID_FRAMELIST
 
 namespace rw {
 
+// The dirty list is shared by all threads, clumps are
+// read on loader threads too. Recursive because syncing
+// objects may dirty frames again.
+#ifndef RW_PS2
+static std::recursive_mutex dirtyListMutex;
+static void lockDirtyList(void) { dirtyListMutex.lock(); }
+static void unlockDirtyList(void) { dirtyListMutex.unlock(); }
+#else
+static void lockDirtyList(void) {}
+static void unlockDirtyList(void) {}
+#endif
+
+int32 frameSyncThreads = 0;
+
 PluginList Frame::s_plglist = { sizeof(Frame), sizeof(Frame), nil, nil };
 static void *frameOpen(void *object, int32 offset, int32 size) { engine->frameDirtyList.init(); return object; }
 static void *frameClose(void *object, int32 offset, int32 size) { return object; }
@@ -25,7 +44,7 @@ Frame::registerModule(void)
 Frame*
 Frame::create(void)
 {
-	Frame *f = (Frame*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_FRAMELIST);
+	Frame *f = (Frame*)objPoolAlloc(OBJPOOL_FRAME, s_plglist.size, MEMDUR_EVENT | ID_FRAMELIST);
 	if(f == nil){
 		RWERROR((ERR_ALLOC, s_plglist.size));
 		return nil;
@@ -35,6 +54,7 @@ Frame::create(void)
 	f->child = nil;
 	f->next = nil;
 	f->root = f;
+	f->hierarchy = nil;
 	f->matrix.setIdentity();
 	f->ltm.setIdentity();
 	s_plglist.construct(f);
@@ -46,6 +66,8 @@ Frame::cloneHierarchy(void)
 {
 	Frame *frame = this->cloneAndLink(nil);
 	frame->purgeClone();
+	if(this->hierarchy)
+		frame->compileHierarchy();
 	return frame;
 }
 
@@ -55,11 +77,15 @@ Frame::destroy(void)
 	s_plglist.destruct(this);
 	if(this->getParent())
 		this->removeChild();
-	if(this->object.privateFlags & Frame::HIERARCHYSYNC)
+	this->uncompileHierarchy();
+	if(this->object.privateFlags & Frame::HIERARCHYSYNC){
+		lockDirtyList();
 		this->inDirtyList.remove();
+		unlockDirtyList();
+	}
 	for(Frame *f = this->child; f; f = f->next)
 		f->object.parent = nil;
-	rwFree(this);
+	objPoolFree(OBJPOOL_FRAME, this);
 }
 
 void
@@ -71,9 +97,15 @@ Frame::destroyHierarchy(void)
 		child->destroyHierarchy();
 	}
 	s_plglist.destruct(this);
-	if(this->object.privateFlags & Frame::HIERARCHYSYNC)
+	if(this->root != this && this->root->hierarchy)
+		this->root->hierarchy->stale = 1;
+	this->uncompileHierarchy();
+	if(this->object.privateFlags & Frame::HIERARCHYSYNC){
+		lockDirtyList();
 		this->inDirtyList.remove();
-	rwFree(this);
+		unlockDirtyList();
+	}
+	objPoolFree(OBJPOOL_FRAME, this);
 }
 
 Frame*
@@ -97,10 +129,15 @@ Frame::addChild(Frame *child, bool32 append)
 	child->object.parent = this;
 	child->root = this->root;
 	for(c = child->child; c; c = c->next)
-		c->setHierarchyRoot(this);
+		c->setHierarchyRoot(this->root);
+	child->uncompileHierarchy();
+	if(this->root->hierarchy)
+		this->root->hierarchy->stale = 1;
 	// If the child was a root, remove from dirty list
 	if(child->object.privateFlags & Frame::HIERARCHYSYNC){
+		lockDirtyList();
 		child->inDirtyList.remove();
+		unlockDirtyList();
 		child->object.privateFlags &= ~Frame::HIERARCHYSYNC;
 	}
 	this->updateObjects();
@@ -120,6 +157,8 @@ Frame::removeChild(void)
 		child->next = this->next;
 	}
 	this->object.parent = this->next = nil;
+	if(this->root->hierarchy)
+		this->root->hierarchy->stale = 1;
 	// give the hierarchy a new root
 	this->setHierarchyRoot(this);
 	this->updateObjects();
@@ -208,10 +247,122 @@ syncRecurse(Frame *frame, uint8 hierarchyFlags)
 	}
 }
 
+/*
+ * Compiled hierarchies
+ */
+
+// Depth first, so siblings' subtrees stay together like in the pool
+static int32
+flattenHierarchy(FrameHierarchy *h, Frame *frame, int32 parent, int32 n)
+{
+	for(; frame; frame = frame->next){
+		h->frames[n] = frame;
+		h->parents[n] = parent;
+		n = flattenHierarchy(h, frame->child, n, n+1);
+	}
+	return n;
+}
+
+FrameHierarchy*
+FrameHierarchy::create(Frame *root)
+{
+	int32 n = root->count();
+	uint32 sz = sizeof(FrameHierarchy) + n*(sizeof(Frame*) + sizeof(int32) + 1);
+	FrameHierarchy *h = (FrameHierarchy*)rwMalloc(sz, MEMDUR_EVENT | ID_FRAMELIST);
+	if(h == nil){
+		RWERROR((ERR_ALLOC, sz));
+		return nil;
+	}
+	h->numFrames = n;
+	h->frames = (Frame**)(h+1);
+	h->parents = (int32*)(h->frames + n);
+	h->dirty = (uint8*)(h->parents + n);
+	h->stale = 0;
+	h->frames[0] = root;
+	h->parents[0] = -1;
+	flattenHierarchy(h, root->child, 0, 1);
+	return h;
+}
+
+void
+FrameHierarchy::destroy(void)
+{
+	rwFree(this);
+}
+
+// One pass so every frame is only touched once
+void
+FrameHierarchy::sync(bool32 ltm, bool32 objects)
+{
+	int32 i;
+	uint8 d;
+	Frame *f;
+	Frame **frames = this->frames;
+	int32 *parents = this->parents;
+	uint8 clear = (ltm ? Frame::SUBTREESYNCLTM : 0) |
+		(objects ? Frame::SUBTREESYNCOBJ : 0);
+	for(i = 0; i < this->numFrames; i++){
+		f = frames[i];
+		if(ltm){
+			// Parents come first so their LTMs are always done
+			d = f->object.privateFlags & Frame::SUBTREESYNCLTM;
+			if(i == 0){
+				if(d)
+					f->ltm = f->matrix;
+			}else{
+				d |= this->dirty[parents[i]];
+				if(d)
+					Matrix::mult(&f->ltm, &f->matrix, &frames[parents[i]]->ltm);
+			}
+			this->dirty[i] = d;
+		}
+		if(objects)
+			FORLIST(lnk, f->objectList)
+				ObjectWithFrame::fromFrame(lnk)->sync();
+		f->object.privateFlags &= ~clear;
+	}
+}
+
+bool32
+Frame::compileHierarchy(void)
+{
+	if(this->getParent())
+		return 0;
+	if(this->hierarchy == nil)
+		this->hierarchy = FrameHierarchy::create(this);
+	return this->hierarchy != nil;
+}
+
+void
+Frame::uncompileHierarchy(void)
+{
+	if(this->hierarchy){
+		this->hierarchy->destroy();
+		this->hierarchy = nil;
+	}
+}
+
+// Compiled hierarchy of a root, rebuilt if the frames changed
+static FrameHierarchy*
+getHierarchy(Frame *root)
+{
+	if(root->hierarchy && root->hierarchy->stale){
+		root->hierarchy->destroy();
+		root->hierarchy = FrameHierarchy::create(root);
+	}
+	return root->hierarchy;
+}
+
 /* Sync the LTMs of the hierarchy of which 'this' is the root */
 void
 Frame::syncHierarchyLTM(void)
 {
+	FrameHierarchy *h = getHierarchy(this);
+	if(h){
+		h->sync(1, 0);
+		this->object.privateFlags &= ~Frame::SYNCLTM;
+		return;
+	}
 	// Sync root's LTM
 	if(this->object.privateFlags & Frame::SUBTREESYNCLTM)
 		this->ltm = this->matrix;
@@ -229,14 +380,162 @@ Frame::getLTM(void)
 	return &this->ltm;
 }
 
+#define MAXTHREADSAFESYNCS 16
+#define MAXSYNCFORWARDS 4
+struct ThreadSafeSync
+{
+	ObjectWithFrame::Sync cb;
+	ObjectWithFrame::Sync (*forwardsTo)(ObjectWithFrame*);
+};
+static ThreadSafeSync threadSafeSyncs[MAXTHREADSAFESYNCS];
+static int32 numThreadSafeSyncs;
+
+static ThreadSafeSync*
+findThreadSafeSync(ObjectWithFrame::Sync cb)
+{
+	for(int32 i = 0; i < numThreadSafeSyncs; i++)
+		if(threadSafeSyncs[i].cb == cb)
+			return &threadSafeSyncs[i];
+	return nil;
+}
+
+void
+ObjectWithFrame::registerThreadSafeSync(Sync cb, Sync (*forwardsTo)(ObjectWithFrame*))
+{
+	if(findThreadSafeSync(cb))
+		return;
+	assert(numThreadSafeSyncs < MAXTHREADSAFESYNCS);
+	threadSafeSyncs[numThreadSafeSyncs].cb = cb;
+	threadSafeSyncs[numThreadSafeSyncs].forwardsTo = forwardsTo;
+	numThreadSafeSyncs++;
+}
+
+bool32
+ObjectWithFrame::isThreadSafeSync(Sync cb)
+{
+	return findThreadSafeSync(cb) != nil;
+}
+
+// Follow forwarding callbacks to the one that does the work
+bool32
+ObjectWithFrame::hasThreadSafeSync(void)
+{
+	Sync cb = this->syncCB;
+	for(int32 i = 0; i < MAXSYNCFORWARDS; i++){
+		ThreadSafeSync *s = findThreadSafeSync(cb);
+		if(s == nil)
+			return 0;
+		if(s->forwardsTo == nil)
+			return 1;
+		cb = s->forwardsTo(this);
+	}
+	return 0;
+}
+
+// Synch the objects of one frame that may or may not be synched
+// in parallel. Returns whether any of the others are attached.
+static bool32
+syncFrameObjects(Frame *frame, bool32 threadSafe)
+{
+	bool32 others = 0;
+	FORLIST(lnk, frame->objectList){
+		ObjectWithFrame *obj = ObjectWithFrame::fromFrame(lnk);
+		if(obj->hasThreadSafeSync() == threadSafe)
+			obj->sync();
+		else
+			others = 1;
+	}
+	return others;
+}
+
+static bool32
+syncObjSplitRecurse(Frame *frame, bool32 threadSafe)
+{
+	bool32 others = 0;
+	for(; frame; frame = frame->next){
+		others |= syncFrameObjects(frame, threadSafe);
+		frame->object.privateFlags &= ~Frame::SUBTREESYNCOBJ;
+		others |= syncObjSplitRecurse(frame->child, threadSafe);
+	}
+	return others;
+}
+
+struct SyncJob
+{
+	Frame **roots;
+	uint8 *serial;	// roots with objects that have to be synched serially
+	int32 numRoots;
+};
+#define ROOTSPERJOB 16
+
+static void
+syncRootsJob(void *data, int32 n)
+{
+	SyncJob *job = (SyncJob*)data;
+	int32 i = n*ROOTSPERJOB;
+	int32 end = i+ROOTSPERJOB;
+	if(end > job->numRoots)
+		end = job->numRoots;
+	for(; i < end; i++){
+		Frame *root = job->roots[i];
+		if(root->object.privateFlags & Frame::HIERARCHYSYNCLTM)
+			root->syncHierarchyLTM();
+		job->serial[i] = syncFrameObjects(root, 1) |
+			syncObjSplitRecurse(root->child, 1);
+	}
+}
+
+// LTMs and thread safe objects are synched on frameSyncThreads threads,
+// the remaining objects afterwards in dirty list order.
+static void
+syncDirtyParallel(int32 numRoots)
+{
+	int32 i;
+	Frame *root;
+	SyncJob job;
+	FrameAllocator *fa = FrameAllocator::get();
+	FrameAllocator::Mark mark = fa->getMark();
+	job.roots = rwFrameNewT(Frame*, numRoots);
+	job.serial = rwFrameNewT(uint8, numRoots);
+	job.numRoots = numRoots;
+	i = 0;
+	FORLIST(lnk, engine->frameDirtyList){
+		root = LLLinkGetData(lnk, Frame, inDirtyList);
+		// rebuild here, not on the workers
+		getHierarchy(root);
+		job.roots[i++] = root;
+	}
+	runJobs(frameSyncThreads, (numRoots+ROOTSPERJOB-1)/ROOTSPERJOB, syncRootsJob, &job);
+	for(i = 0; i < numRoots; i++){
+		root = job.roots[i];
+		if(job.serial[i]){
+			syncFrameObjects(root, 0);
+			syncObjSplitRecurse(root->child, 0);
+		}
+		root->object.privateFlags &= ~(Frame::SYNCLTM | Frame::SYNCOBJ);
+	}
+	fa->release(&mark);
+}
+
 /* Synch all dirty frames; LTMs and objects */
 void
 Frame::syncDirty(void)
 {
 	Frame *frame;
+	int32 numRoots;
+	lockDirtyList();
+	if(frameSyncThreads > 1 &&
+	   (numRoots = engine->frameDirtyList.count()) > ROOTSPERJOB){
+		syncDirtyParallel(numRoots);
+		engine->frameDirtyList.init();
+		unlockDirtyList();
+		return;
+	}
 	FORLIST(lnk, engine->frameDirtyList){
 		frame = LLLinkGetData(lnk, Frame, inDirtyList);
-		if(frame->object.privateFlags & Frame::HIERARCHYSYNCLTM){
+		if(FrameHierarchy *h = getHierarchy(frame))
+			h->sync(frame->object.privateFlags & Frame::HIERARCHYSYNCLTM, 1);
+		else if(frame->object.privateFlags & Frame::HIERARCHYSYNCLTM){
 			// Sync root's LTM
 			if(frame->object.privateFlags & Frame::SUBTREESYNCLTM)
 				frame->ltm = frame->matrix;
@@ -255,6 +554,7 @@ Frame::syncDirty(void)
 		frame->object.privateFlags &= ~(Frame::SYNCLTM | Frame::SYNCOBJ);
 	}
 	engine->frameDirtyList.init();
+	unlockDirtyList();
 }
 
 void
@@ -289,8 +589,11 @@ void
 Frame::updateObjects(void)
 {
 	// Mark root as dirty and insert into dirty list if necessary
-	if((this->root->object.privateFlags & HIERARCHYSYNC) == 0)
+	if((this->root->object.privateFlags & HIERARCHYSYNC) == 0){
+		lockDirtyList();
 		engine->frameDirtyList.add(&this->root->inDirtyList);
+		unlockDirtyList();
+	}
 	this->root->object.privateFlags |= HIERARCHYSYNC;
 	// Mark subtree as dirty as well
 	this->object.privateFlags |= SUBTREESYNC;
@@ -387,11 +690,13 @@ FrameList_::streamWrite(Stream *stream)
 
 	int size = 0, structsize = 0;
 	structsize = 4 + this->numFrames*sizeof(FrameStreamData);
-	size += 12 + structsize;
-	for(int32 i = 0; i < this->numFrames; i++)
-		size += 12 + Frame::s_plglist.streamGetSize(this->frames[i]);
+	if(needChunkSize()){
+		size += 12 + structsize;
+		for(int32 i = 0; i < this->numFrames; i++)
+			size += 12 + Frame::s_plglist.streamGetSize(this->frames[i]);
+	}
 
-	writeChunkHeader(stream, ID_FRAMELIST, size);
+	uint32 start = beginChunk(stream, ID_FRAMELIST, size);
 	writeChunkHeader(stream, ID_STRUCT, structsize);
 	stream->writeU32(this->numFrames);
 	for(int32 i = 0; i < this->numFrames; i++){
@@ -407,6 +712,7 @@ FrameList_::streamWrite(Stream *stream)
 	}
 	for(int32 i = 0; i < this->numFrames; i++)
 		Frame::s_plglist.streamWrite(stream, this->frames[i]);
+	endChunk(stream, start, size);
 }
 
 static Frame*
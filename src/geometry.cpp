@@ -11,6 +11,11 @@
 #include "rwobjects.h"
 #include "rwengine.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#define RW_SSE2
+#include <emmintrin.h>
+#endif
+
 #define PLUGIN_ID ID_GEOMETRY
 
 namespace rw {
@@ -18,23 +23,20 @@ namespace rw {
 PluginList Geometry::s_plglist = { sizeof(Geometry), sizeof(Geometry), nil, nil };
 PluginList Material::s_plglist = { sizeof(Material), sizeof(Material), nil, nil };
 
-static SurfaceProperties defaultSurfaceProps = { 1.0f, 1.0f, 1.0f };
+// set while reading materials of pre-3.4 geometry
+static RWTHREADLOCAL SurfaceProperties defaultSurfaceProps = { 1.0f, 1.0f, 1.0f };
 
-// We allocate twice because we have to allocate the data separately for uninstancing
-Geometry*
-Geometry::create(int32 numVerts, int32 numTris, uint32 flags)
+#define ALIGN16(x) (((x)+15) & ~15)
+
+static void
+initGeometry(Geometry *geo, int32 numVerts, int32 numTris, uint32 flags)
 {
-	Geometry *geo = (Geometry*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_GEOMETRY);
-	if(geo == nil){
-		RWERROR((ERR_ALLOC, s_plglist.size));
-		return nil;
-	}
 	geo->object.init(Geometry::ID, 0);
 	geo->flags = flags & 0xFF00FFFF;
 	geo->numTexCoordSets = (flags & 0xFF0000) >> 16;
 	if(geo->numTexCoordSets == 0)
-		geo->numTexCoordSets = (geo->flags & TEXTURED)  ? 1 :
-		                       (geo->flags & TEXTURED2) ? 2 : 0;
+		geo->numTexCoordSets = (geo->flags & Geometry::TEXTURED)  ? 1 :
+		                       (geo->flags & Geometry::TEXTURED2) ? 2 : 0;
 	geo->numTriangles = numTris;
 	geo->numVertices = numVerts;
 
@@ -42,45 +44,191 @@ Geometry::create(int32 numVerts, int32 numTris, uint32 flags)
 	for(int32 i = 0; i < 8; i++)
 		geo->texCoords[i] = nil;
 	geo->triangles = nil;
-	// Allocate all attributes at once. The triangle pointer
-	// will hold the first address (even when there are no triangles)
-	// so we can free easily.
-	if(!(geo->flags & NATIVE)){
-		int32 sz = geo->numTriangles*sizeof(Triangle);
-		if(geo->flags & PRELIT)
-			sz += geo->numVertices*sizeof(RGBA);
-		sz += geo->numTexCoordSets*geo->numVertices*sizeof(TexCoords);
-
-		uint8 *data = (uint8*)rwNew(sz, MEMDUR_EVENT | ID_GEOMETRY);
-		geo->triangles = (Triangle*)data;
-		data += geo->numTriangles*sizeof(Triangle);
-		if(geo->flags & PRELIT && geo->numVertices){
-			geo->colors = (RGBA*)data;
-			data += geo->numVertices*sizeof(RGBA);
-		}
-		if(geo->numVertices)
-			for(int32 i = 0; i < geo->numTexCoordSets; i++){
-				geo->texCoords[i] = (TexCoords*)data;
-				data += geo->numVertices*sizeof(TexCoords);
-			}
-
-		// init triangles
-		for(int32 i = 0; i < geo->numTriangles; i++)
-			geo->triangles[i].matId = 0xFFFF;
-	}
 	geo->numMorphTargets = 0;
 	geo->morphTargets = nil;
-	geo->addMorphTargets(1);
 
 	geo->matList.init();
 	geo->meshHeader = nil;
 	geo->instData = nil;
 	geo->refCount = 1;
+	geo->packedSize = 0;
+}
+
+// Size of triangles, prelight colors and tex coords
+static int32
+geoDataSize(Geometry *geo)
+{
+	int32 sz = geo->numTriangles*sizeof(Triangle);
+	if(geo->flags & Geometry::PRELIT)
+		sz += geo->numVertices*sizeof(RGBA);
+	sz += geo->numTexCoordSets*geo->numVertices*sizeof(TexCoords);
+	return sz;
+}
+
+// The triangle pointer will hold the first address
+// (even when there are no triangles) so we can free easily.
+static void
+setupGeoData(Geometry *geo, uint8 *data)
+{
+	geo->triangles = (Triangle*)data;
+	data += geo->numTriangles*sizeof(Triangle);
+	if(geo->flags & Geometry::PRELIT && geo->numVertices){
+		geo->colors = (RGBA*)data;
+		data += geo->numVertices*sizeof(RGBA);
+	}
+	if(geo->numVertices)
+		for(int32 i = 0; i < geo->numTexCoordSets; i++){
+			geo->texCoords[i] = (TexCoords*)data;
+			data += geo->numVertices*sizeof(TexCoords);
+		}
+
+	// init triangles
+	for(int32 i = 0; i < geo->numTriangles; i++)
+		geo->triangles[i].matId = 0xFFFF;
+}
+
+// Size of one morph target including its vertex data
+static int32
+morphTargetSize(Geometry *geo)
+{
+	int32 sz = sizeof(MorphTarget);
+	if(!(geo->flags & Geometry::NATIVE)){
+		sz += geo->numVertices*sizeof(V3d);
+		if(geo->flags & Geometry::NORMALS)
+			sz += geo->numVertices*sizeof(V3d);
+	}
+	return sz;
+}
+
+// Memory layout: MorphTarget[n]; (vertices and normals)[n]
+// Initializes the bounding sphere for new morph targets
+static void
+setupMorphTargets(Geometry *geo, MorphTarget *mts, int32 n)
+{
+	geo->morphTargets = mts;
+	V3d *data  = (V3d*)&mts[n];
+	for(int32 i = 0; i < n; i++){
+		mts->parent = geo;
+		mts->vertices = nil;
+		mts->normals = nil;
+		if(i >= geo->numMorphTargets){
+			mts->boundingSphere.center.x = 0.0f;
+			mts->boundingSphere.center.y = 0.0f;
+			mts->boundingSphere.center.z = 0.0f;
+			mts->boundingSphere.radius = 0.0f;
+		}
+		if(!(geo->flags & Geometry::NATIVE) && geo->numVertices){
+			mts->vertices = data;
+			data += geo->numVertices;
+			if(geo->flags & Geometry::NORMALS){
+				mts->normals = data;
+				data += geo->numVertices;
+			}
+		}
+		mts++;
+	}
+	geo->numMorphTargets = n;
+}
+
+// We allocate twice because we have to allocate the data separately for uninstancing
+Geometry*
+Geometry::create(int32 numVerts, int32 numTris, uint32 flags)
+{
+	Geometry *geo = (Geometry*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_GEOMETRY);
+	if(geo == nil){
+		RWERROR((ERR_ALLOC, s_plglist.size));
+		return nil;
+	}
+	initGeometry(geo, numVerts, numTris, flags);
+	// Allocate all attributes at once.
+	if(!(geo->flags & NATIVE))
+		setupGeoData(geo, (uint8*)rwNew(geoDataSize(geo), MEMDUR_EVENT | ID_GEOMETRY));
+	geo->addMorphTargets(1);
+
+	s_plglist.construct(geo);
+	return geo;
+}
+
+// Everything in one block, each part aligned to 16 bytes:
+// Geometry and plugins; triangles, colors, tex coords;
+// morph targets and their vertices; mesh header, meshes and indices
+Geometry*
+Geometry::createPacked(int32 numVerts, int32 numTris, uint32 flags,
+	int32 numMorphTargets, int32 numMeshes, uint32 numIndices)
+{
+	Geometry tmp;
+	uint32 geoSz, dataSz, mtSz, meshSz;
+	uint8 *block;
+
+	// only need the counts
+	initGeometry(&tmp, numVerts, numTris, flags);
+	if(numMorphTargets < 1)
+		numMorphTargets = 1;
+	geoSz = ALIGN16(s_plglist.size);
+	dataSz = tmp.flags & NATIVE ? 0 : ALIGN16(geoDataSize(&tmp));
+	mtSz = ALIGN16(numMorphTargets*morphTargetSize(&tmp));
+	meshSz = 0;
+	if(numMeshes)
+		meshSz = sizeof(MeshHeader) + numMeshes*sizeof(Mesh) + numIndices*sizeof(uint16);
+
+	block = (uint8*)rwMalloc(geoSz + dataSz + mtSz + meshSz, MEMDUR_EVENT | ID_GEOMETRY);
+	if(block == nil){
+		RWERROR((ERR_ALLOC, geoSz + dataSz + mtSz + meshSz));
+		return nil;
+	}
+	Geometry *geo = (Geometry*)block;
+	initGeometry(geo, numVerts, numTris, flags);
+	geo->packedSize = geoSz + dataSz + mtSz + meshSz;
+	block += geoSz;
+	if(dataSz){
+		setupGeoData(geo, block);
+		block += dataSz;
+	}
+	setupMorphTargets(geo, (MorphTarget*)block, numMorphTargets);
+	block += mtSz;
+	if(numMeshes){
+		// like allocateMeshes
+		MeshHeader *mh = (MeshHeader*)block;
+		mh->flags = 0;
+		mh->numMeshes = numMeshes;
+		mh->serialNum = 0;
+		mh->totalIndices = numIndices;
+		Mesh *m = mh->getMeshes();
+		for(int32 i = 0; i < numMeshes; i++){
+			m[i].material = nil;
+			m[i].numIndices = 0;
+			m[i].indices = (uint16*)&m[numMeshes];
+		}
+		geo->meshHeader = mh;
+	}
 
 	s_plglist.construct(geo);
 	return geo;
 }
 
+// Free memory that may be part of a packed geometry
+void
+Geometry::freeData(void *p)
+{
+	if((uint8*)p >= (uint8*)this && (uint8*)p < (uint8*)this + this->packedSize)
+		return;
+	rwFree(p);
+}
+
+// Like rwResize but moves memory out of a packed geometry
+void*
+Geometry::resizeData(void *p, uint32 oldSize, uint32 newSize)
+{
+	if(p == nil ||
+	   (uint8*)p < (uint8*)this || (uint8*)p >= (uint8*)this + this->packedSize)
+		return rwResize(p, newSize, MEMDUR_EVENT | ID_GEOMETRY);
+	if(newSize <= oldSize)
+		return p;
+	void *newp = rwNew(newSize, MEMDUR_EVENT | ID_GEOMETRY);
+	memcpy(newp, p, oldSize < newSize ? oldSize : newSize);
+	return newp;
+}
+
 void
 Geometry::destroy(void)
 {
@@ -88,11 +236,11 @@ Geometry::destroy(void)
 	if(this->refCount <= 0){
 		s_plglist.destruct(this);
 		// Also frees colors and tex coords
-		rwFree(this->triangles);
+		this->freeData(this->triangles);
 		// Also frees their data
-		rwFree(this->morphTargets);
+		this->freeData(this->morphTargets);
 		// Also frees indices
-		rwFree(this->meshHeader);
+		this->freeData(this->meshHeader);
 		this->matList.deinit();
 		rwFree(this);
 	}
@@ -106,75 +254,371 @@ struct GeoStreamData
 	int32 numMorphTargets;
 };
 
-Geometry*
-Geometry::streamRead(Stream *stream)
+// Triangles are streamed as v[1], v[0], matId, v[2],
+// so we only have to swap the halves of every word.
+// Works in place.
+void
+unpackTriangles(Triangle *dst, uint32 *src, int32 numTris)
 {
+	uint32 *d = (uint32*)dst;
+	int32 i = 0;
+	int32 n = 2*numTris;
+#ifdef RW_SSE2
+	for(; i+4 <= n; i += 4){
+		__m128i x = _mm_loadu_si128((__m128i*)&src[i]);
+		x = _mm_or_si128(_mm_srli_epi32(x, 16), _mm_slli_epi32(x, 16));
+		_mm_storeu_si128((__m128i*)&d[i], x);
+	}
+#endif
+	for(; i < n; i++)
+		d[i] = src[i]>>16 | src[i]<<16;
+}
+
+// the swap is its own inverse
+void
+packTriangles(uint32 *dst, Triangle *src, int32 numTris)
+{
+	unpackTriangles((Triangle*)dst, (uint32*)src, numTris);
+}
+
+// Mesh indices are streamed as 32 bits.
+// Works in place.
+void
+unpackIndices(uint16 *dst, uint32 *src, int32 numIndices)
+{
+	int32 i = 0;
+#ifdef RW_SSE2
+	for(; i+8 <= numIndices; i += 8){
+		__m128i a = _mm_loadu_si128((__m128i*)&src[i]);
+		__m128i b = _mm_loadu_si128((__m128i*)&src[i+4]);
+		// sign extend the low half so the saturating pack keeps it
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_packs_epi32(a, b));
+	}
+#endif
+	for(; i < numIndices; i++)
+		dst[i] = src[i];
+}
+
+void
+packIndices(uint32 *dst, uint16 *src, int32 numIndices)
+{
+	int32 i = 0;
+#ifdef RW_SSE2
+	__m128i zero = _mm_setzero_si128();
+	for(; i+8 <= numIndices; i += 8){
+		__m128i x = _mm_loadu_si128((__m128i*)&src[i]);
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_unpacklo_epi16(x, zero));
+		_mm_storeu_si128((__m128i*)&dst[i+4], _mm_unpackhi_epi16(x, zero));
+	}
+#endif
+	for(; i < numIndices; i++)
+		dst[i] = src[i];
+}
+
+// Create a geometry whose attributes point into data.
+// Only triangles are unpacked into memory of their own.
+static Geometry*
+borrowGeometry(uint8 *data, uint32 length, GeoStreamData *buf)
+{
+	uint8 *end = data + length;
+	// Pretend to be native so nothing but the
+	// morph targets themselves is allocated
+	Geometry *geo = Geometry::createPacked(buf->numVertices, buf->numTriangles,
+	                                       buf->flags | Geometry::NATIVE,
+	                                       buf->numMorphTargets);
+	if(geo == nil)
+		return nil;
+	geo->flags &= ~Geometry::NATIVE;
+
+	int32 nv = geo->numVertices;
+	if(geo->flags & Geometry::PRELIT && nv){
+		geo->colors = (RGBA*)data;
+		data += nv*sizeof(RGBA);
+	}
+	if(nv)
+		for(int32 i = 0; i < geo->numTexCoordSets; i++){
+			geo->texCoords[i] = (TexCoords*)data;
+			data += nv*sizeof(TexCoords);
+		}
+	geo->triangles = rwNewT(Triangle, geo->numTriangles, MEMDUR_EVENT | ID_GEOMETRY);
+	if(data + 8*geo->numTriangles > end)
+		goto fail;
+	unpackTriangles(geo->triangles, (uint32*)data, geo->numTriangles);
+	data += 8*geo->numTriangles;
+
+	for(int32 i = 0; i < geo->numMorphTargets; i++){
+		MorphTarget *m = &geo->morphTargets[i];
+		if(data + 4*4 + 2*4 > end)
+			goto fail;
+		memcpy(&m->boundingSphere, data, 4*4);
+		int32 hasVertices = ((int32*)data)[4];
+		int32 hasNormals = ((int32*)data)[5];
+		data += 4*4 + 2*4;
+		if(hasVertices){
+			m->vertices = (V3d*)data;
+			data += nv*sizeof(V3d);
+		}
+		if(hasNormals){
+			m->normals = (V3d*)data;
+			data += nv*sizeof(V3d);
+		}
+	}
+	if(data > end)
+		goto fail;
+	geo->object.privateFlags |= Geometry::BORROWED;
+	return geo;
+
+fail:
+	RWERROR((ERR_GENERAL, "geometry data too short"));
+	geo->destroy();
+	return nil;
+}
+
+// Everything about a geometry that is read before its material list
+struct GeoReadJob
+{
+	Geometry *geo;
 	uint32 version;
-	GeoStreamData buf;
 	SurfaceProperties surfProps;
-	MaterialList *ret;
-	static SurfaceProperties reset = { 1.0f, 1.0f, 1.0f };
+	bool32 borrow;
+	// only for parallel reading
+	uint8 *data;
+	uint32 length;
+	uint32 pos;
+};
 
-	if(!findChunk(stream, ID_STRUCT, nil, &version)){
+// The data the counts promise has to fit into the STRUCT,
+// broken counts would overflow the packed allocation otherwise
+static bool32
+geoCountsFit(GeoStreamData *buf, uint32 length)
+{
+	uint64 need;
+	if(buf->numVertices < 0 || buf->numTriangles < 0 || buf->numMorphTargets < 0)
+		return 0;
+	need = (uint64)buf->numMorphTargets*(4*4 + 2*4);
+	if(!(buf->flags & Geometry::NATIVE)){
+		need += (uint64)buf->numTriangles*8;
+		if(buf->flags & Geometry::POSITIONS)
+			need += (uint64)buf->numMorphTargets*buf->numVertices*3*4;
+	}
+	return need <= length;
+}
+
+// Read the geometry STRUCT. Stream state and errors are per thread
+// and runJobs hands them over, allocation is thread safe, so this
+// can run on several geometries in parallel as long as geometry
+// plugin constructors only touch their own geometry.
+static Geometry*
+readGeoStruct(Stream *stream, GeoReadJob *job)
+{
+	uint32 length;
+	GeoStreamData buf;
+	Geometry *geo;
+	uint8 *data;
+
+	job->geo = nil;
+	if(!findChunk(stream, ID_STRUCT, &length, &job->version)){
 		RWERROR((ERR_CHUNK, "STRUCT"));
 		return nil;
 	}
-	stream->read(&buf, sizeof(buf));
-	Geometry *geo = Geometry::create(buf.numVertices,
-	                                 buf.numTriangles, buf.flags);
-	if(geo == nil)
+	if(length < sizeof(buf) ||
+	   stream->read(&buf, sizeof(buf)) != sizeof(buf)){
+		RWERROR((ERR_GENERAL, "geometry data too short"));
 		return nil;
-	geo->addMorphTargets(buf.numMorphTargets-1);
-	if(version < 0x34000)
-		stream->read(&surfProps, 12);
+	}
+	length -= sizeof(buf);
+	if(job->version < 0x34000){
+		if(length < 12){
+			RWERROR((ERR_GENERAL, "geometry data too short"));
+			return nil;
+		}
+		stream->read(&job->surfProps, 12);
+		length -= 12;
+	}
+	if(!geoCountsFit(&buf, length)){
+		RWERROR((ERR_GENERAL, "bad geometry counts"));
+		return nil;
+	}
 
-	if(!(geo->flags & NATIVE)){
-		if(geo->flags & PRELIT)
-			stream->read(geo->colors, 4*geo->numVertices);
-		for(int32 i = 0; i < geo->numTexCoordSets; i++)
-			stream->read(geo->texCoords[i],
-				    2*geo->numVertices*4);
-		for(int32 i = 0; i < geo->numTriangles; i++){
-			uint32 tribuf[2];
-			stream->read(tribuf, 8);
-			geo->triangles[i].v[0]  = tribuf[0] >> 16;
-			geo->triangles[i].v[1]  = tribuf[0];
-			geo->triangles[i].v[2]  = tribuf[1] >> 16;
-			geo->triangles[i].matId = tribuf[1];
+	data = nil;
+	if(job->borrow && !(buf.flags & Geometry::NATIVE)){
+		data = stream->getData(length);
+		// can't point to misaligned data
+		if(data && (uintptr)data & 3){
+			stream->seek(-(int32)length);
+			data = nil;
 		}
 	}
+	if(data){
+		geo = borrowGeometry(data, length, &buf);
+		if(geo == nil)
+			return nil;
+	}else{
+		geo = Geometry::createPacked(buf.numVertices, buf.numTriangles,
+		                             buf.flags, buf.numMorphTargets);
+		if(geo == nil)
+			return nil;
 
-	for(int32 i = 0; i < geo->numMorphTargets; i++){
-		MorphTarget *m = &geo->morphTargets[i];
-		stream->read(&m->boundingSphere, 4*4);
-		int32 hasVertices = stream->readI32();
-		int32 hasNormals = stream->readI32();
-		if(hasVertices)
-			stream->read(m->vertices, 3*geo->numVertices*4);
-		if(hasNormals)
-			stream->read(m->normals, 3*geo->numVertices*4);
+		if(!(geo->flags & Geometry::NATIVE)){
+			if(geo->flags & Geometry::PRELIT)
+				stream->read(geo->colors, 4*geo->numVertices);
+			for(int32 i = 0; i < geo->numTexCoordSets; i++)
+				stream->read(geo->texCoords[i],
+					    2*geo->numVertices*4);
+			uint32 *tridata = (uint32*)stream->getData(8*geo->numTriangles);
+			if(tridata == nil){
+				// unpack in place
+				tridata = (uint32*)geo->triangles;
+				stream->read(tridata, 8*geo->numTriangles);
+			}
+			unpackTriangles(geo->triangles, tridata, geo->numTriangles);
+		}
+
+		for(int32 i = 0; i < geo->numMorphTargets; i++){
+			MorphTarget *m = &geo->morphTargets[i];
+			stream->read(&m->boundingSphere, 4*4);
+			int32 hasVertices = stream->readI32();
+			int32 hasNormals = stream->readI32();
+			if(hasVertices)
+				stream->read(m->vertices, 3*geo->numVertices*4);
+			if(hasNormals)
+				stream->read(m->normals, 3*geo->numVertices*4);
+		}
 	}
+	job->geo = geo;
+	return geo;
+}
 
+// Read material list and extension, destroys the geometry on failure
+static Geometry*
+readGeoRest(Stream *stream, GeoReadJob *job)
+{
+	MaterialList *ret;
+	Geometry *geo = job->geo;
+	static SurfaceProperties reset = { 1.0f, 1.0f, 1.0f };
+
+	job->geo = nil;
 	if(!findChunk(stream, ID_MATLIST, nil, nil)){
 		RWERROR((ERR_CHUNK, "MATLIST"));
 		goto fail;
 	}
-	if(version < 0x34000)
-		defaultSurfaceProps = surfProps;
+	if(job->version < 0x34000)
+		defaultSurfaceProps = job->surfProps;
 
 	ret = MaterialList::streamRead(stream, &geo->matList);
-	if(version < 0x34000)
+	if(job->version < 0x34000)
 		defaultSurfaceProps = reset;
 	if(ret == nil)
 		goto fail;
-	if(s_plglist.streamRead(stream, geo))
+	if(Geometry::s_plglist.streamRead(stream, geo)){
+		job->geo = geo;
 		return geo;
+	}
 
 fail:
 	geo->destroy();
 	return nil;
 }
 
+Geometry*
+Geometry::streamRead(Stream *stream)
+{
+	GeoReadJob job;
+	job.borrow = streamBorrowGeometry;
+	if(readGeoStruct(stream, &job) == nil)
+		return nil;
+	return readGeoRest(stream, &job);
+}
+
+static void
+geoReadJob(void *data, int32 i)
+{
+	GeoReadJob *job = &((GeoReadJob*)data)[i];
+	StreamMemory view;
+	view.open(job->data, job->length);
+	readGeoStruct(&view, job);
+	job->pos = view.tell();
+}
+
+bool32
+Geometry::streamReadList(Stream *stream, uint32 length, Geometry **geometryList, int32 numGeometries)
+{
+	int32 i;
+	if(streamLoadThreads <= 1 || numGeometries <= 1){
+		for(i = 0; i < numGeometries; i++){
+			if(!findChunk(stream, ID_GEOMETRY, nil, nil)){
+				RWERROR((ERR_CHUNK, "GEOMETRY"));
+				return 0;
+			}
+			geometryList[i] = Geometry::streamRead(stream);
+			if(geometryList[i] == nil)
+				return 0;
+		}
+		return 1;
+	}
+
+	uint32 start = stream->tell();
+	bool32 success = 0;
+	// Geometry may only point into the stream's own buffer
+	bool32 borrow = streamBorrowGeometry;
+	uint8 *buf = stream->getData(length);
+	uint8 *owned = nil;
+	if(buf == nil){
+		buf = owned = rwNewT(uint8, length, MEMDUR_FUNCTION | ID_GEOMETRY);
+		stream->read(buf, length);
+		borrow = 0;
+	}
+
+	// Find all geometry chunks first
+	GeoReadJob *jobs = rwNewT(GeoReadJob, numGeometries, MEMDUR_FUNCTION | ID_GEOMETRY);
+	StreamMemory scan;
+	scan.open(buf, length);
+	uint32 len, end;
+	for(i = 0; i < numGeometries; i++){
+		jobs[i].geo = nil;
+		jobs[i].borrow = borrow;
+	}
+	for(i = 0; i < numGeometries; i++){
+		if(!findChunk(&scan, ID_GEOMETRY, &len, nil) ||
+		   scan.tell()+len > length){
+			RWERROR((ERR_CHUNK, "GEOMETRY"));
+			goto fail;
+		}
+		jobs[i].data = buf+scan.tell();
+		jobs[i].length = len;
+		scan.seek(len);
+	}
+	end = scan.tell();
+
+	runJobs(streamLoadThreads, numGeometries, geoReadJob, jobs);
+
+	// Material lists and plugins aren't thread safe, finish serially
+	for(i = 0; i < numGeometries; i++){
+		if(jobs[i].geo == nil)
+			goto fail;
+		scan.open(jobs[i].data, jobs[i].length);
+		scan.seek(jobs[i].pos, 0);
+		if(readGeoRest(&scan, &jobs[i]) == nil)
+			goto fail;
+	}
+	for(i = 0; i < numGeometries; i++)
+		geometryList[i] = jobs[i].geo;
+	// leave stream after the last geometry like serial reading does
+	stream->seek(start + end, 0);
+	success = 1;
+
+fail:
+	if(!success)
+		for(i = 0; i < numGeometries; i++)
+			if(jobs[i].geo)
+				jobs[i].geo->destroy();
+	rwFree(jobs);
+	rwFree(owned);
+	return success;
+}
+
 static uint32
 geoStructSize(Geometry *geo)
 {
@@ -208,7 +652,8 @@ Geometry::streamWrite(Stream *stream)
 	GeoStreamData buf;
 	static float32 fbuf[3] = { 1.0f, 1.0f, 1.0f };
 
-	writeChunkHeader(stream, ID_GEOMETRY, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_GEOMETRY, size);
 	writeChunkHeader(stream, ID_STRUCT, geoStructSize(this));
 
 	buf.flags = this->flags | this->numTexCoordSets << 16;
@@ -225,13 +670,14 @@ Geometry::streamWrite(Stream *stream)
 		for(int32 i = 0; i < this->numTexCoordSets; i++)
 			stream->write(this->texCoords[i],
 				    2*this->numVertices*4);
-		for(int32 i = 0; i < this->numTriangles; i++){
-			uint32 tribuf[2];
-			tribuf[0] = this->triangles[i].v[0] << 16 |
-			            this->triangles[i].v[1];
-			tribuf[1] = this->triangles[i].v[2] << 16 |
-			            this->triangles[i].matId;
-			stream->write(tribuf, 8);
+		uint32 tribuf[2*128];
+		Triangle *tri = this->triangles;
+		int32 numTris = this->numTriangles;
+		for(; numTris > 0; numTris -= 128){
+			int32 n = numTris < 128 ? numTris : 128;
+			packTriangles(tribuf, tri, n);
+			stream->write(tribuf, n*8);
+			tri += n;
 		}
 	}
 
@@ -256,6 +702,7 @@ Geometry::streamWrite(Stream *stream)
 	this->matList.streamWrite(stream);
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
@@ -274,55 +721,24 @@ Geometry::addMorphTargets(int32 n)
 {
 	if(n == 0)
 		return;
+	// vertex data has to follow the morph targets
+	this->lock(LOCKALL);
 	n += this->numMorphTargets;
 
-	int32 sz;
-	sz = sizeof(MorphTarget);
-	if(!(this->flags & NATIVE)){
-		sz += this->numVertices*sizeof(V3d);
-		if(this->flags & NORMALS)
-			sz += this->numVertices*sizeof(V3d);
-	}
-
-	// Memory layout: MorphTarget[n]; (vertices and normals)[n]
+	int32 sz = morphTargetSize(this);
 	MorphTarget *mts;
 	if(this->numMorphTargets){
-		mts = (MorphTarget*)rwResize(this->morphTargets, n*sz, MEMDUR_EVENT | ID_GEOMETRY);
-		this->morphTargets = mts;
+		mts = (MorphTarget*)this->resizeData(this->morphTargets,
+			this->numMorphTargets*sz, n*sz);
 		// Since we now have more morph targets than before, move the vertex data up
 		uint8 *src = (uint8*)mts + sz*this->numMorphTargets;
 		uint8 *dst = (uint8*)mts + sz*n;
 		uint32 len = (sz-sizeof(MorphTarget))*this->numMorphTargets;
 		while(len--)
 			*--dst = *--src;
-	}else{
+	}else
 		mts = (MorphTarget*)rwNew(n*sz, MEMDUR_EVENT | ID_GEOMETRY);
-		this->morphTargets = mts;
-	}
-
-	// Set up everything and initialize the bounding sphere for new morph targets
-	V3d *data  = (V3d*)&mts[n];
-	for(int32 i = 0; i < n; i++){
-		mts->parent = this;
-		mts->vertices = nil;
-		mts->normals = nil;
-		if(i >= this->numMorphTargets){
-			mts->boundingSphere.center.x = 0.0f;
-			mts->boundingSphere.center.y = 0.0f;
-			mts->boundingSphere.center.z = 0.0f;
-			mts->boundingSphere.radius = 0.0f;
-		}
-		if(!(this->flags & NATIVE) && this->numVertices){
-			mts->vertices = data;
-			data += this->numVertices;
-			if(this->flags & NORMALS){
-				mts->normals = data;
-				data += this->numVertices;
-			}
-		}
-		mts++;
-	}
-	this->numMorphTargets = n;
+	setupMorphTargets(this, mts, n);
 }
 
 void
@@ -391,8 +807,8 @@ Geometry::allocateData(void)
 	if(this->flags & NORMALS)
 		sz += this->numVertices*sizeof(V3d);
 
-	MorphTarget *mt = (MorphTarget*)rwResize(this->morphTargets,
-		sz*this->numMorphTargets, MEMDUR_EVENT | ID_GEOMETRY);
+	MorphTarget *mt = (MorphTarget*)this->resizeData(this->morphTargets,
+		sizeof(MorphTarget)*this->numMorphTargets, sz*this->numMorphTargets);
 	this->morphTargets = mt;
 	V3d *vdata = (V3d*)&mt[this->numMorphTargets];
 	for(int32 i = 0; i < this->numMorphTargets; i++){
@@ -411,6 +827,47 @@ Geometry::allocateData(void)
 	}
 }
 
+// Borrowed data is copied so it can be written to.
+void
+Geometry::lock(int32 lockFlags)
+{
+	// triangles are never borrowed
+	if(!(this->object.privateFlags & BORROWED) ||
+	   (lockFlags & ~LOCKPOLYGONS) == 0)
+		return;
+
+	int32 i;
+	Triangle *tris = this->triangles;
+	RGBA *colors = this->colors;
+	TexCoords *texCoords[8];
+	for(i = 0; i < this->numTexCoordSets; i++)
+		texCoords[i] = this->texCoords[i];
+	V3d **mtdata = rwNewT(V3d*, 2*this->numMorphTargets, MEMDUR_FUNCTION | ID_GEOMETRY);
+	for(i = 0; i < this->numMorphTargets; i++){
+		mtdata[i*2+0] = this->morphTargets[i].vertices;
+		mtdata[i*2+1] = this->morphTargets[i].normals;
+	}
+
+	this->allocateData();
+
+	int32 nv = this->numVertices;
+	memcpy(this->triangles, tris, this->numTriangles*sizeof(Triangle));
+	this->freeData(tris);
+	if(colors)
+		memcpy(this->colors, colors, nv*sizeof(RGBA));
+	for(i = 0; i < this->numTexCoordSets; i++)
+		memcpy(this->texCoords[i], texCoords[i], nv*sizeof(TexCoords));
+	for(i = 0; i < this->numMorphTargets; i++){
+		MorphTarget *m = &this->morphTargets[i];
+		if(mtdata[i*2+0])
+			memcpy(m->vertices, mtdata[i*2+0], nv*sizeof(V3d));
+		if(mtdata[i*2+1])
+			memcpy(m->normals, mtdata[i*2+1], nv*sizeof(V3d));
+	}
+	rwFree(mtdata);
+	this->object.privateFlags &= ~BORROWED;
+}
+
 static int
 isDegenerate(uint16 *idx)
 {
@@ -506,7 +963,7 @@ Geometry::buildMeshes(void)
 	Triangle *tri;
 	Mesh *mesh;
 
-	rwFree(this->meshHeader);
+	this->freeData(this->meshHeader);
 	this->meshHeader = nil;
 	int32 numMeshes = this->matList.numMaterials;
 	if((this->flags & Geometry::TRISTRIP) == 0){
@@ -598,7 +1055,7 @@ Geometry::correctTristripWinding(void)
 		mesh++;
 		newmesh++;
 	}
-	rwFree(header);
+	this->freeData(header);
 	// Now allocate indices and copy them
 	this->allocateMeshes(newhead->numMeshes, newhead->totalIndices, 0);
 	memcpy(this->meshHeader->getMeshes()->indices, indices, this->meshHeader->totalIndices*2);
@@ -660,7 +1117,7 @@ Geometry::removeUnusedMaterials(void)
 		       m[i].numIndices*sizeof(*m[i].indices));
 		newm++;
 	}
-	rwFree(mh);
+	this->freeData(mh);
 
 	/* Remap triangle material IDs */
 	for(int32 i = 0; i < this->numTriangles; i++)
@@ -772,8 +1229,8 @@ fail:
 bool
 MaterialList::streamWrite(Stream *stream)
 {
-	uint32 size = this->streamGetSize();
-	writeChunkHeader(stream, ID_MATLIST, size);
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_MATLIST, size);
 	writeChunkHeader(stream, ID_STRUCT, 4 + this->numMaterials*4);
 	stream->writeI32(this->numMaterials);
 
@@ -794,6 +1251,7 @@ MaterialList::streamWrite(Stream *stream)
 		this->materials[i]->streamWrite(stream);
 		found:;
 	}
+	endChunk(stream, start, size);
 	return true;
 }
 
@@ -818,7 +1276,7 @@ MaterialList::streamGetSize(void)
 Material*
 Material::create(void)
 {
-	Material *mat = (Material*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_MATERIAL);
+	Material *mat = (Material*)objPoolAlloc(OBJPOOL_MATERIAL, s_plglist.size, MEMDUR_EVENT | ID_MATERIAL);
 	if(mat == nil){
 		RWERROR((ERR_ALLOC, s_plglist.size));
 		return nil;
@@ -857,7 +1315,7 @@ Material::destroy(void)
 		s_plglist.destruct(this);
 		if(this->texture)
 			this->texture->destroy();
-		rwFree(this);
+		objPoolFree(OBJPOOL_MATERIAL, this);
 	}
 }
 
@@ -879,7 +1337,7 @@ struct MatStreamData
 	int32 textured;
 };
 
-static uint32 materialRights[2];
+static RWTHREADLOCAL uint32 materialRights[2];
 
 Material*
 Material::streamRead(Stream *stream)
@@ -926,7 +1384,8 @@ Material::streamWrite(Stream *stream)
 {
 	MatStreamData buf;
 
-	writeChunkHeader(stream, ID_MATERIAL, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_MATERIAL, size);
 	writeChunkHeader(stream, ID_STRUCT, sizeof(MatStreamData)
 		+ (rw::version >= 0x30400 ? 12 : 0));
 
@@ -948,6 +1407,7 @@ Material::streamWrite(Stream *stream)
 		this->texture->streamWrite(stream);
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
@@ -30,7 +30,7 @@ namespace rw {
 MeshHeader*
 Geometry::allocateMeshes(int32 numMeshes, uint32 numIndices, bool32 noIndices)
 {
-	uint32 sz;
+	uint32 sz, oldsz;
 	MeshHeader *mh;
 	Mesh *m;
 	uint16 *indices;
@@ -40,8 +40,12 @@ Geometry::allocateMeshes(int32 numMeshes, uint32 numIndices, bool32 noIndices)
 	if(!noIndices)
 		sz += numIndices*sizeof(uint16);
 	if(this->meshHeader){
-		oldNumMeshes = this->meshHeader->numMeshes;
-		mh = (MeshHeader*)rwResize(this->meshHeader, sz, MEMDUR_EVENT | ID_GEOMETRY);
+		mh = this->meshHeader;
+		oldNumMeshes = mh->numMeshes;
+		oldsz = sizeof(MeshHeader) + oldNumMeshes*sizeof(Mesh);
+		if(oldNumMeshes && mh->getMeshes()->indices)
+			oldsz += mh->totalIndices*sizeof(uint16);
+		mh = (MeshHeader*)this->resizeData(mh, oldsz, sz);
 		this->meshHeader = mh;
 	}else{
 		oldNumMeshes = 0;
@@ -110,7 +114,7 @@ readMesh(Stream *stream, int32 len, void *object, int32, int32)
 	MeshStream ms;
 	MeshHeader *mh;
 	Mesh *mesh;
-	int32 indbuf[256];
+	uint32 indbuf[256];
 	uint16 *indices;
 	Geometry *geo = (Geometry*)object;
 
@@ -142,11 +146,13 @@ readMesh(Stream *stream, int32 len, void *object, int32, int32)
 			indices += mesh->numIndices;
 			uint16 *ind = mesh->indices;
 			int32 numIndices = mesh->numIndices;
-			for(; numIndices > 0; numIndices -= 256){
+			uint32 *data = (uint32*)stream->getData(numIndices*4);
+			if(data)
+				unpackIndices(ind, data, numIndices);
+			else for(; numIndices > 0; numIndices -= 256){
 				int32 n = numIndices < 256 ? numIndices : 256;
 				stream->read(indbuf, n*4);
-				for(int32 j = 0; j < n; j++)
-					ind[j] = indbuf[j];
+				unpackIndices(ind, indbuf, n);
 				ind += n;
 			}
 		}
@@ -160,7 +166,7 @@ writeMesh(Stream *stream, int32, void *object, int32, int32)
 {
 	MeshHeaderStream mhs;
 	MeshStream ms;
-	int32 indbuf[256];
+	uint32 indbuf[256];
 	Geometry *geo = (Geometry*)object;
 	mhs.flags = geo->meshHeader->flags;
 	mhs.numMeshes = geo->meshHeader->numMeshes;
@@ -181,8 +187,7 @@ writeMesh(Stream *stream, int32, void *object, int32, int32)
 			int32 numIndices = mesh->numIndices;
 			for(; numIndices > 0; numIndices -= 256){
 				int32 n = numIndices < 256 ? numIndices : 256;
-				for(int32 j = 0; j < n; j++)
-					indbuf[j] = ind[j];
+				packIndices(indbuf, ind, n);
 				stream->write(indbuf, n*4);
 				ind += n;
 			}
@@ -224,9 +224,8 @@ updateSkinMatrices(Atomic *a)
 
 	float *m;
 	m = (float*)skinMatrices;
+	Matrix::multArray((Matrix*)m, invMats, hier->matrices, hier->numNodes);
 	for(int i = 0; i < hier->numNodes; i++){
-		invMats[i].flags = 0;
-		Matrix::mult((Matrix*)m, &invMats[i], &hier->matrices[i]);
 		m[3] = 0.0f;
 		m[7] = 0.0f;
 		m[11] = 0.0f;
@@ -41,14 +41,11 @@ HAnimHierarchy::create(int32 numNodes, int32 *nodeFlags, int32 *nodeIDs,
 	hier->flags = flags;
 	hier->parentFrame = nil;
 	hier->parentHierarchy = hier;
-	if(hier->flags & NOMATRICES){
+	if(hier->flags & NOMATRICES)
 		hier->matrices = nil;
-		hier->matricesUnaligned = nil;
-	}else{
-		hier->matricesUnaligned = rwNew(hier->numNodes*64 + 0xF, MEMDUR_EVENT | ID_HANIM);
-		hier->matrices =
-		  (Matrix*)((uintptr)hier->matricesUnaligned & ~0xF);
-	}
+	else
+		hier->matrices = (Matrix*)rwNewAligned(hier->numNodes*sizeof(Matrix), 64,
+			MEMDUR_EVENT | ID_HANIM);
 	hier->nodeInfo = rwNewT(HAnimNodeInfo, hier->numNodes, MEMDUR_EVENT | ID_HANIM);
 	for(int32 i = 0; i < hier->numNodes; i++){
 		hier->nodeInfo[i].id = nodeIDs[i];
@@ -62,7 +59,7 @@ HAnimHierarchy::create(int32 numNodes, int32 *nodeFlags, int32 *nodeIDs,
 void
 HAnimHierarchy::destroy(void)
 {
-	rwFree(this->matricesUnaligned);
+	rwFreeAligned(this->matrices);
 	rwFree(this->nodeInfo);
 	rwFree(this);
 }
@@ -145,36 +142,42 @@ HAnimHierarchy::updateMatrices(void)
 {
 	// TODO: handle more (all!) cases
 
-	Matrix rootMat, animMat;
-	Matrix *curMat, *parentMat;
-	Matrix **sp, *stack[64];
+	Matrix *rootMat;
+	Matrix *animMats;
+	int32 *parents;
+	int32 parent, *sp, stack[64];
 	Frame *frm, *parfrm;
 	int32 i;
 	AnimInterpolator *anim = this->currentAnim;
-
-	sp = stack;
-	curMat = this->matrices;
+	FrameAllocator *fa = FrameAllocator::get();
+	FrameAllocator::Mark mark = fa->getMark();
 
 	frm = this->parentFrame;
+	rootMat = nil;	// identity
 	if(frm && (parfrm = frm->getParent()))
-		rootMat = *parfrm->getLTM();
-	else
-		rootMat.setIdentity();
-	parentMat = &rootMat;
+		rootMat = parfrm->getLTM();
+
+	// Interpolate and find the parents first,
+	// then concatenate everything in one go
+	animMats = rwFrameNewT(Matrix, this->numNodes);
+	parents = rwFrameNewT(int32, this->numNodes);
+	sp = stack;
+	parent = -1;
 	HAnimNodeInfo *node = this->nodeInfo;
 	for(i = 0; i < this->numNodes; i++){
-		anim->applyCB(&animMat, anim->getInterpFrame(i));
-		Matrix::mult(curMat, parentMat, &animMat);
+		anim->applyCB(&animMats[i], anim->getInterpFrame(i));
+		parents[i] = parent;
 
 		if(node->flags & PUSH)
-			*sp++ = parentMat;
-		parentMat = curMat;
+			*sp++ = parent;
+		parent = i;
 		if(node->flags & POP)
-			parentMat = *--sp;
+			parent = *--sp;
 
 		node++;
-		curMat++;
 	}
+	Matrix::multHierarchy(this->matrices, animMats, parents, this->numNodes, rootMat);
+	fa->release(&mark);
 }
 
 HAnimData*
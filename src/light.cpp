@@ -26,6 +26,19 @@ worldLightSync(ObjectWithFrame *obj)
 	light->originalSync(obj);
 }
 
+static ObjectWithFrame::Sync
+worldLightSyncForwardsTo(ObjectWithFrame *obj)
+{
+	return ((Light*)obj)->originalSync;
+}
+
+void
+Light::registerModule(void)
+{
+	ObjectWithFrame::registerThreadSafeSync(lightSync);
+	ObjectWithFrame::registerThreadSafeSync(worldLightSync, worldLightSyncForwardsTo);
+}
+
 Light*
 Light::create(int32 type)
 {
@@ -132,7 +145,8 @@ bool
 Light::streamWrite(Stream *stream)
 {
 	LightChunkData buf;
-	writeChunkHeader(stream, ID_LIGHT, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_LIGHT, size);
 	writeChunkHeader(stream, ID_STRUCT, sizeof(LightChunkData));
 	buf.radius = this->radius;
 	buf.red   = this->color.red;
@@ -147,6 +161,7 @@ Light::streamWrite(Stream *stream)
 	stream->write(&buf, sizeof(LightChunkData));
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
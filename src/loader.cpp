@@ -0,0 +1,445 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#ifndef RW_PS2
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#endif
+
+#include "rwbase.h"
+#include "rwerror.h"
+#include "rwplg.h"
+#include "rwpipeline.h"
+#include "rwobjects.h"
+#include "rwengine.h"
+#include "rwloader.h"
+
+#define PLUGIN_ID 0
+
+// Parsing creates rasters and so needs the device. Only the null
+// device may be used from any thread, otherwise the I/O thread
+// just reads and requests are parsed inside poll().
+#if defined(RW_NULL) && !defined(RW_PS2)
+#define PARSEONWORKERS
+#endif
+
+namespace rw {
+
+struct AssetRequest
+{
+	LLLink inList;
+	int32 id;
+	int32 type;
+	int32 priority;
+	bool32 cancelled;
+	char *path;
+	AssetLoader::Callback cb;
+	void *data;
+	StreamContext context;
+	uint8 *buffer;
+	uint32 length;
+	void *object;
+};
+#define REQLINK(lnk) LLLinkGetData(lnk, AssetRequest, inList)
+
+struct AssetLoaderImpl : AssetLoader
+{
+	LinkList ioQueue;	// QUEUED
+	LinkList parseQueue;	// READ
+	LinkList doneQueue;	// DONE
+	LinkList busyList;	// READING and PARSING
+	int32 nextId;
+	bool32 parsingClump;
+#ifndef RW_PS2
+	std::mutex mutex;
+	std::condition_variable ioCond;		// ioQueue
+	std::condition_variable workCond;	// parseQueue
+	std::condition_variable doneCond;	// doneQueue and busyList
+	bool32 quit;
+	std::thread ioThread;
+#endif
+#ifdef PARSEONWORKERS
+	std::thread *workers;
+	int32 numWorkers;
+#endif
+};
+
+static void
+destroyObject(int32 type, void *object)
+{
+	if(object == nil)
+		return;
+	if(type == ID_CLUMP)
+		((Clump*)object)->destroy();
+	else
+		((TexDictionary*)object)->destroy();
+}
+
+static void
+freeRequest(AssetRequest *req)
+{
+	destroyObject(req->type, req->object);
+	rwFree(req->buffer);
+	rwFree(req->path);
+	rwFree(req);
+}
+
+// Keep list sorted by priority, first come first served otherwise
+static void
+enqueue(LinkList *list, AssetRequest *req)
+{
+	LLLink *lnk;
+	for(lnk = list->link.next; lnk != list->end(); lnk = lnk->next)
+		if(REQLINK(lnk)->priority < req->priority)
+			break;
+	// insert before lnk
+	req->inList.next = lnk;
+	req->inList.prev = lnk->prev;
+	lnk->prev->next = &req->inList;
+	lnk->prev = &req->inList;
+}
+
+static AssetRequest*
+dequeue(LinkList *list)
+{
+	if(list->isEmpty())
+		return nil;
+	AssetRequest *req = REQLINK(list->link.next);
+	req->inList.remove();
+	return req;
+}
+
+static void
+readRequest(AssetRequest *req)
+{
+	StreamFile file;
+	if(file.open(req->path, "rb") == nil){
+		RWERROR((ERR_FILE, req->path));
+		return;
+	}
+	file.seek(0, 2);
+	req->length = file.tell();
+	file.seek(0, 0);
+	req->buffer = rwNewT(uint8, req->length, MEMDUR_EVENT);
+	if(file.read(req->buffer, req->length) != req->length){
+		RWERROR((ERR_FILE, req->path));
+		rwFree(req->buffer);
+		req->buffer = nil;
+	}
+	file.close();
+}
+
+static void
+parseRequest(AssetRequest *req)
+{
+	StreamMemory stream;
+	if(req->buffer == nil)
+		return;
+	req->context.setCurrent();
+	stream.open(req->buffer, req->length);
+	if(findChunk(&stream, req->type, nil, nil)){
+		if(req->type == ID_CLUMP){
+			Clump *c = Clump::streamRead(&stream);
+			// the buffer is freed below
+			if(c && streamBorrowGeometry)
+				FORLIST(lnk, c->atomics)
+					Atomic::fromClump(lnk)->geometry->lock(Geometry::LOCKALL);
+			req->object = c;
+		}else
+			req->object = TexDictionary::streamRead(&stream);
+	}else
+		RWERROR((ERR_CHUNK, req->type == ID_CLUMP ? "CLUMP" : "TEXDICTIONARY"));
+	rwFree(req->buffer);
+	req->buffer = nil;
+}
+
+#ifndef RW_PS2
+static void
+ioThreadFunc(AssetLoaderImpl *ld)
+{
+	AssetRequest *req;
+	std::unique_lock<std::mutex> lock(ld->mutex);
+	for(;;){
+		while(!ld->quit && ld->ioQueue.isEmpty())
+			ld->ioCond.wait(lock);
+		if(ld->quit)
+			return;
+		req = dequeue(&ld->ioQueue);
+		ld->busyList.append(&req->inList);
+		lock.unlock();
+		readRequest(req);
+		lock.lock();
+		req->inList.remove();
+		if(req->cancelled){
+			freeRequest(req);
+			ld->doneCond.notify_all();
+			continue;
+		}
+		enqueue(&ld->parseQueue, req);
+#ifdef PARSEONWORKERS
+		ld->workCond.notify_one();
+#else
+		// finish() waits for this
+		ld->doneCond.notify_all();
+#endif
+	}
+}
+#endif
+
+#ifdef PARSEONWORKERS
+// Take the first request that may be parsed now
+static AssetRequest*
+nextParseRequest(AssetLoaderImpl *ld)
+{
+	FORLIST(lnk, ld->parseQueue){
+		AssetRequest *req = REQLINK(lnk);
+		bool32 exclusive = req->type == ID_CLUMP && req->context.texDict;
+		if(exclusive && ld->parsingClump)
+			continue;
+		req->inList.remove();
+		return req;
+	}
+	return nil;
+}
+
+static void
+workerThreadFunc(AssetLoaderImpl *ld)
+{
+	AssetRequest *req;
+	std::unique_lock<std::mutex> lock(ld->mutex);
+	for(;;){
+		while(!ld->quit && (req = nextParseRequest(ld)) == nil)
+			ld->workCond.wait(lock);
+		if(ld->quit)
+			return;
+		bool32 exclusive = req->type == ID_CLUMP && req->context.texDict;
+		if(exclusive)
+			ld->parsingClump = 1;
+		ld->busyList.append(&req->inList);
+		lock.unlock();
+		parseRequest(req);
+		lock.lock();
+		req->inList.remove();
+		if(exclusive){
+			ld->parsingClump = 0;
+			ld->workCond.notify_all();
+		}
+		if(req->cancelled)
+			freeRequest(req);
+		else{
+			ld->doneQueue.append(&req->inList);
+		}
+		ld->doneCond.notify_all();
+	}
+}
+#endif
+
+AssetLoader*
+AssetLoader::create(int32 numWorkers)
+{
+	AssetLoaderImpl *ld = new AssetLoaderImpl;
+	ld->ioQueue.init();
+	ld->parseQueue.init();
+	ld->doneQueue.init();
+	ld->busyList.init();
+	ld->nextId = 0;
+	ld->parsingClump = 0;
+#ifndef RW_PS2
+	ld->quit = 0;
+	ld->ioThread = std::thread(ioThreadFunc, ld);
+#endif
+#ifdef PARSEONWORKERS
+	if(numWorkers < 1)
+		numWorkers = 1;
+	ld->numWorkers = numWorkers;
+	ld->workers = new std::thread[numWorkers];
+	for(int32 i = 0; i < numWorkers; i++)
+		ld->workers[i] = std::thread(workerThreadFunc, ld);
+#endif
+	return ld;
+}
+
+void
+AssetLoader::destroy(void)
+{
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+	AssetRequest *req;
+#ifndef RW_PS2
+	{
+		std::unique_lock<std::mutex> lock(ld->mutex);
+		// let running requests finish, drop the rest
+		while((req = dequeue(&ld->ioQueue)))
+			freeRequest(req);
+		while((req = dequeue(&ld->parseQueue)))
+			freeRequest(req);
+		while(!ld->busyList.isEmpty())
+			ld->doneCond.wait(lock);
+		ld->quit = 1;
+		ld->ioCond.notify_all();
+		ld->workCond.notify_all();
+	}
+	ld->ioThread.join();
+#endif
+#ifdef PARSEONWORKERS
+	for(int32 i = 0; i < ld->numWorkers; i++)
+		ld->workers[i].join();
+	delete[] ld->workers;
+#endif
+	// reads that finished while we were waiting end up here
+	while((req = dequeue(&ld->ioQueue)))
+		freeRequest(req);
+	while((req = dequeue(&ld->parseQueue)))
+		freeRequest(req);
+	while((req = dequeue(&ld->doneQueue)))
+		freeRequest(req);
+	delete ld;
+}
+
+int32
+AssetLoader::request(const char *path, int32 type, int32 priority,
+	Callback cb, void *data)
+{
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+	if(type != ID_CLUMP && type != ID_TEXDICTIONARY)
+		return -1;
+	AssetRequest *req = rwNewT(AssetRequest, 1, MEMDUR_EVENT);
+	req->type = type;
+	req->priority = priority;
+	req->cancelled = 0;
+	req->path = rwNewT(char, strlen(path)+1, MEMDUR_EVENT);
+	strcpy(req->path, path);
+	req->cb = cb;
+	req->data = data;
+	req->context.getCurrent();
+	req->buffer = nil;
+	req->length = 0;
+	req->object = nil;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(ld->mutex);
+#endif
+	req->id = ld->nextId++;
+	enqueue(&ld->ioQueue, req);
+#ifndef RW_PS2
+	ld->ioCond.notify_one();
+#endif
+	return req->id;
+}
+
+static AssetRequest*
+findRequest(LinkList *list, int32 id)
+{
+	FORLIST(lnk, *list)
+		if(REQLINK(lnk)->id == id)
+			return REQLINK(lnk);
+	return nil;
+}
+
+bool32
+AssetLoader::cancel(int32 id)
+{
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+	AssetRequest *req;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(ld->mutex);
+#endif
+	if((req = findRequest(&ld->ioQueue, id)) ||
+	   (req = findRequest(&ld->parseQueue, id)) ||
+	   (req = findRequest(&ld->doneQueue, id))){
+		req->inList.remove();
+		freeRequest(req);
+		return 1;
+	}
+	// the thread working on it will free it
+	if((req = findRequest(&ld->busyList, id)) && !req->cancelled){
+		req->cancelled = 1;
+		return 1;
+	}
+	return 0;
+}
+
+int32
+AssetLoader::poll(void)
+{
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+	AssetRequest *req;
+	int32 n = 0;
+#ifdef RW_PS2
+	// no threads, do all the work here
+	while((req = dequeue(&ld->ioQueue))){
+		readRequest(req);
+		parseRequest(req);
+		ld->doneQueue.append(&req->inList);
+	}
+#elif !defined(PARSEONWORKERS)
+	for(;;){
+		{
+			std::lock_guard<std::mutex> lock(ld->mutex);
+			req = dequeue(&ld->parseQueue);
+			if(req == nil)
+				break;
+			ld->busyList.append(&req->inList);
+		}
+		parseRequest(req);
+		std::lock_guard<std::mutex> lock(ld->mutex);
+		req->inList.remove();
+		if(req->cancelled)
+			freeRequest(req);
+		else
+			ld->doneQueue.append(&req->inList);
+		ld->doneCond.notify_all();
+	}
+#endif
+	for(;;){
+		{
+#ifndef RW_PS2
+			std::lock_guard<std::mutex> lock(ld->mutex);
+#endif
+			req = dequeue(&ld->doneQueue);
+		}
+		if(req == nil)
+			break;
+		// callback owns the object now
+		if(req->cb)
+			req->cb(req->id, req->object, req->data);
+		req->object = nil;
+		freeRequest(req);
+		n++;
+	}
+	return n;
+}
+
+void
+AssetLoader::finish(void)
+{
+#ifndef RW_PS2
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+	{
+		std::unique_lock<std::mutex> lock(ld->mutex);
+#ifdef PARSEONWORKERS
+		while(!ld->ioQueue.isEmpty() || !ld->parseQueue.isEmpty() ||
+		      !ld->busyList.isEmpty())
+#else
+		// the rest is parsed by poll()
+		while(!ld->ioQueue.isEmpty() || !ld->busyList.isEmpty())
+#endif
+			ld->doneCond.wait(lock);
+	}
+#endif
+	this->poll();
+}
+
+int32
+AssetLoader::numPending(void)
+{
+	AssetLoaderImpl *ld = (AssetLoaderImpl*)this;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(ld->mutex);
+#endif
+	return ld->ioQueue.count() + ld->parseQueue.count() +
+		ld->doneQueue.count() + ld->busyList.count();
+}
+
+}
@@ -579,7 +579,8 @@ registerMatFXPlugin(void)
 
 	matFXGlobals.atomicOffset =
 	Atomic::registerPlugin(sizeof(int32), ID_MATFX,
-	                       createAtomicMatFX, nil, copyAtomicMatFX);
+	                       createAtomicMatFX, nil, copyAtomicMatFX,
+	                       PLUGINHOT);
 	Atomic::registerPluginStream(ID_MATFX,
 	                             readAtomicMatFX,
 	                             writeAtomicMatFX,
@@ -588,7 +589,7 @@ registerMatFXPlugin(void)
 	matFXGlobals.materialOffset =
 	Material::registerPlugin(sizeof(MatFX*), ID_MATFX,
 	                         createMaterialMatFX, destroyMaterialMatFX,
-	                         copyMaterialMatFX);
+	                         copyMaterialMatFX, PLUGINHOT);
 	Material::registerPluginStream(ID_MATFX,
 	                               readMaterialMatFX,
 	                               writeMaterialMatFX,
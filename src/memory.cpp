@@ -0,0 +1,1272 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#ifndef RW_PS2
+#include <atomic>
+#include <mutex>
+#endif
+
+#include "rwbase.h"
+#include "rwerror.h"
+#include "rwplg.h"
+#include "rwpipeline.h"
+#include "rwobjects.h"
+#include "rwengine.h"
+
+#define PLUGIN_ID 0
+
+namespace rw {
+
+void *malloc_h(size_t sz, uint32 hint);
+void *realloc_h(void *p, size_t sz, uint32 hint);
+void *mustmalloc_h(size_t sz, uint32 hint);
+void *mustrealloc_h(void *p, size_t sz, uint32 hint);
+
+/*
+ * Every block has a header that says where it came from
+ * so rwFree and rwRealloc don't need the hint.
+ */
+
+enum {
+	BLOCK_HEAP,
+	BLOCK_FUNCTION,
+	BLOCK_FRAME,
+	BLOCK_POOL,
+	BLOCK_ALIGNED	// owner is the block it was carved from
+};
+
+struct BlockHeader
+{
+	void *owner;	// Arena or Pool
+	uint32 size;
+	uint32 type;
+};
+#define HEADERSIZE 16
+#define ALIGN16(x) (((x)+15) & ~(size_t)15)
+#define BLOCKHEADER(p) ((BlockHeader*)((uint8*)(p) - HEADERSIZE))
+#define BLOCKDATA(b) ((void*)((uint8*)(b) + HEADERSIZE))
+
+static void*
+heapAlloc(size_t sz)
+{
+	BlockHeader *b = (BlockHeader*)malloc(sz + HEADERSIZE);
+	if(b == nil)
+		return nil;
+	b->owner = nil;
+	b->size = sz;
+	b->type = BLOCK_HEAP;
+	return BLOCKDATA(b);
+}
+
+/*
+ * Arenas. Blocks are bumped off a list of chunks that is kept
+ * around for reuse. Function arenas count their live blocks
+ * and are rewound by the owning thread once all were freed.
+ * Frame arenas ignore frees and back the FrameAllocator,
+ * they are rewound lazily once a new frame was started.
+ * Both are per thread.
+ */
+
+#define ARENACHUNKSIZE (256*1024)
+// Larger function blocks go to the heap,
+// larger frame blocks get a chunk of their own
+#define ARENALARGE (64*1024)
+// A function arena that can't be rewound because some block
+// stays alive doesn't grow beyond this, the heap takes over.
+#define FUNCTIONMAXCHUNKS 4
+
+struct ArenaChunk
+{
+	ArenaChunk *next;
+	size_t size;
+};
+#define CHUNKHEADER 16
+#define CHUNKDATA(c) ((uint8*)(c) + CHUNKHEADER)
+
+struct Arena
+{
+	ArenaChunk *first;
+	ArenaChunk *cur;
+	ArenaChunk *large;
+	uint8 *top, *end;
+	int32 numChunks;	// not counting large ones
+	// Live blocks of a function arena. The owning thread counts
+	// its own allocations and frees in refs (plus one for itself),
+	// other threads count their frees in remoteRefs, which is
+	// offset by REMOTEBIAS until the owner goes away.
+	int32 refs;
+#ifndef RW_PS2
+	std::atomic<int32> remoteRefs;
+#else
+	int32 remoteRefs;
+#endif
+};
+#define REMOTEBIAS 0x40000000
+
+static ArenaChunk*
+newChunk(size_t size)
+{
+	ArenaChunk *c = (ArenaChunk*)malloc(size + CHUNKHEADER);
+	if(c == nil)
+		return nil;
+	c->next = nil;
+	c->size = size;
+	return c;
+}
+
+static void
+freeChunks(ArenaChunk *c)
+{
+	ArenaChunk *next;
+	for(; c; c = next){
+		next = c->next;
+		free(c);
+	}
+}
+
+static void
+rewindArena(Arena *a)
+{
+	freeChunks(a->large);
+	a->large = nil;
+	a->cur = a->first;
+	if(a->cur){
+		a->top = CHUNKDATA(a->cur);
+		a->end = a->top + a->cur->size;
+	}else
+		a->top = a->end = nil;
+}
+
+static void*
+arenaAlloc(Arena *a, size_t sz, uint32 type)
+{
+	BlockHeader *b;
+	size_t need = ALIGN16(sz) + HEADERSIZE;
+	if(need > ARENALARGE){
+		ArenaChunk *c = newChunk(need);
+		if(c == nil)
+			return nil;
+		c->next = a->large;
+		a->large = c;
+		b = (BlockHeader*)CHUNKDATA(c);
+	}else{
+		if(a->top + need > a->end){
+			if(a->cur && a->cur->next)
+				a->cur = a->cur->next;
+			else{
+				ArenaChunk *c = newChunk(ARENACHUNKSIZE);
+				if(c == nil)
+					return nil;
+				if(a->cur)
+					a->cur->next = c;
+				else
+					a->first = c;
+				a->cur = c;
+				a->numChunks++;
+			}
+			a->top = CHUNKDATA(a->cur);
+			a->end = a->top + a->cur->size;
+		}
+		b = (BlockHeader*)a->top;
+		a->top += need;
+	}
+	b->owner = a;
+	b->size = sz;
+	b->type = type;
+	return BLOCKDATA(b);
+}
+
+static Arena*
+newArena(void)
+{
+	Arena *a = (Arena*)malloc(sizeof(Arena));
+	a->first = a->cur = a->large = nil;
+	a->top = a->end = nil;
+	a->numChunks = 0;
+	a->refs = 1;
+	a->remoteRefs = REMOTEBIAS;
+	return a;
+}
+
+static void
+destroyArena(Arena *a)
+{
+	freeChunks(a->first);
+	freeChunks(a->large);
+	free(a);
+}
+
+#ifndef RW_PS2
+static std::atomic<uint32> frameNumber;
+#else
+static uint32 frameNumber;
+#endif
+
+struct FrameArena : FrameAllocator
+{
+	Arena *arena;
+	uint32 frame;	// when arena was last rewound
+};
+
+// The arenas of a thread. Function blocks can outlive
+// their thread, the arena goes away with the last one.
+struct ThreadArenas
+{
+	Arena *function;
+	FrameArena frame;
+
+	~ThreadArenas(void){
+		Arena *a = this->function;
+		// hand the remaining blocks over to the other threads
+		if(a && (a->remoteRefs += a->refs - 1 - REMOTEBIAS) == 0)
+			destroyArena(a);
+		if(this->frame.arena)
+			destroyArena(this->frame.arena);
+	}
+};
+static RWTHREADLOCAL ThreadArenas threadArenas;
+
+static void
+functionFree(Arena *a)
+{
+	if(a == threadArenas.function)
+		a->refs--;
+	else if(--a->remoteRefs == 0)
+		destroyArena(a);
+}
+
+static void*
+functionAlloc(size_t sz)
+{
+	Arena *a = threadArenas.function;
+	size_t need = ALIGN16(sz) + HEADERSIZE;
+	if(need > ARENALARGE)
+		return heapAlloc(sz);
+	if(a == nil)
+		a = threadArenas.function = newArena();
+	else if(a->refs + a->remoteRefs - REMOTEBIAS == 1)
+		rewindArena(a);
+	if(a->numChunks >= FUNCTIONMAXCHUNKS &&
+	   a->top + need > a->end && a->cur->next == nil)
+		return heapAlloc(sz);
+	void *p = arenaAlloc(a, sz, BLOCK_FUNCTION);
+	if(p)
+		a->refs++;
+	return p;
+}
+
+static Arena*
+getFrameArena(FrameArena *fa)
+{
+	uint32 frame = frameNumber;
+	if(fa->arena == nil)
+		fa->arena = newArena();
+	else if(fa->frame != frame)
+		rewindArena(fa->arena);
+	fa->frame = frame;
+	return fa->arena;
+}
+
+static void*
+frameAlloc(size_t sz)
+{
+	return arenaAlloc(getFrameArena(&threadArenas.frame), sz, BLOCK_FRAME);
+}
+
+void
+resetFrameMemory(void)
+{
+	frameNumber++;
+}
+
+FrameAllocator*
+FrameAllocator::get(void)
+{
+	return &threadArenas.frame;
+}
+
+void*
+FrameAllocator::alloc(size_t sz)
+{
+	Arena *a = getFrameArena((FrameArena*)this);
+	uint8 *p;
+	sz = sz ? ALIGN16(sz) : 16;
+	if(sz <= ARENALARGE && a->top + sz <= a->end){
+		p = a->top;
+		a->top += sz;
+		return p;
+	}
+	// let arenaAlloc find room and take back the header
+	p = (uint8*)arenaAlloc(a, sz - HEADERSIZE, BLOCK_FRAME);
+	return p ? p - HEADERSIZE : nil;
+}
+
+void*
+FrameAllocator::resize(void *p, size_t oldSz, size_t newSz)
+{
+	Arena *a = getFrameArena((FrameArena*)this);
+	void *newp;
+	oldSz = ALIGN16(oldSz);
+	newSz = ALIGN16(newSz);
+	if(p == nil)
+		return this->alloc(newSz);
+	if(newSz <= oldSz)
+		return p;
+	if((uint8*)p + oldSz == a->top && (uint8*)p + newSz <= a->end){
+		a->top = (uint8*)p + newSz;
+		return p;
+	}
+	newp = this->alloc(newSz);
+	if(newp)
+		memcpy(newp, p, oldSz);
+	return newp;
+}
+
+FrameAllocator::Mark
+FrameAllocator::getMark(void)
+{
+	Arena *a = getFrameArena((FrameArena*)this);
+	Mark m;
+	m.chunk = a->cur;
+	m.top = a->top;
+	m.large = a->large;
+	return m;
+}
+
+void
+FrameAllocator::release(Mark *mark)
+{
+	Arena *a = getFrameArena((FrameArena*)this);
+	ArenaChunk *c;
+	while(a->large && a->large != mark->large){
+		c = a->large;
+		a->large = c->next;
+		free(c);
+	}
+	// mark was taken before the first chunk existed,
+	// large chunks older than it have to stay
+	if(mark->chunk == nil){
+		a->cur = a->first;
+		if(a->cur){
+			a->top = CHUNKDATA(a->cur);
+			a->end = a->top + a->cur->size;
+		}else
+			a->top = a->end = nil;
+		return;
+	}
+	a->cur = (ArenaChunk*)mark->chunk;
+	a->top = mark->top;
+	a->end = CHUNKDATA(a->cur) + a->cur->size;
+}
+
+/*
+ * Pools. Small blocks of one size class are carved from
+ * slabs and kept on a free list, slabs are never released.
+ */
+
+#define POOLSLABSIZE (64*1024)
+#define POOLMINSHIFT 4
+#define NUMPOOLS 7	// 16 to 1024 bytes
+
+struct PoolSlab
+{
+	PoolSlab *next;
+};
+#define SLABHEADER 16
+
+struct Pool
+{
+	void *freeList;
+	PoolSlab *slabs;
+	uint8 *top, *end;
+#ifndef RW_PS2
+	std::mutex mutex;
+#endif
+};
+static Pool pools[NUMPOOLS];
+
+static int32
+sizeClass(size_t sz)
+{
+	int32 i;
+	for(i = 0; i < NUMPOOLS; i++)
+		if(sz <= (size_t)1 << (i+POOLMINSHIFT))
+			return i;
+	return -1;
+}
+
+#define POOLBLOCKSIZE(pool) ((size_t)1 << ((pool)-pools + POOLMINSHIFT))
+
+static void*
+poolAlloc(Pool *pool, size_t sz)
+{
+	BlockHeader *b;
+	size_t need = POOLBLOCKSIZE(pool) + HEADERSIZE;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+	if(pool->freeList){
+		b = (BlockHeader*)pool->freeList;
+		pool->freeList = b->owner;
+	}else{
+		if(pool->top + need > pool->end){
+			PoolSlab *s = (PoolSlab*)malloc(POOLSLABSIZE + SLABHEADER);
+			if(s == nil)
+				return nil;
+			s->next = pool->slabs;
+			pool->slabs = s;
+			pool->top = (uint8*)s + SLABHEADER;
+			pool->end = pool->top + POOLSLABSIZE;
+		}
+		b = (BlockHeader*)pool->top;
+		pool->top += need;
+	}
+	b->owner = pool;
+	b->size = sz;
+	b->type = BLOCK_POOL;
+	return BLOCKDATA(b);
+}
+
+static void
+poolFree(Pool *pool, BlockHeader *b)
+{
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+	// owner doubles as the free list link
+	b->owner = pool->freeList;
+	pool->freeList = b;
+}
+
+// Freed blocks are cached per thread to avoid the lock
+#define POOLCACHESIZE 64
+
+struct PoolCache
+{
+	BlockHeader *list[NUMPOOLS];
+	int32 count[NUMPOOLS];
+
+	~PoolCache(void){
+		BlockHeader *b;
+		for(int32 i = 0; i < NUMPOOLS; i++)
+			while(b = this->list[i], b){
+				this->list[i] = (BlockHeader*)b->owner;
+				poolFree(&pools[i], b);
+			}
+	}
+};
+static RWTHREADLOCAL PoolCache poolCache;
+
+static void*
+eventAlloc(size_t sz)
+{
+	BlockHeader *b;
+	int32 i = sizeClass(sz);
+	if(i < 0)
+		return heapAlloc(sz);
+	b = poolCache.list[i];
+	if(b == nil)
+		return poolAlloc(&pools[i], sz);
+	poolCache.list[i] = (BlockHeader*)b->owner;
+	poolCache.count[i]--;
+	b->owner = &pools[i];
+	b->size = sz;
+	return BLOCKDATA(b);
+}
+
+static void
+eventFree(Pool *pool, BlockHeader *b)
+{
+	int32 i = pool - pools;
+	if(poolCache.count[i] >= POOLCACHESIZE){
+		poolFree(pool, b);
+		return;
+	}
+	b->owner = poolCache.list[i];
+	poolCache.list[i] = b;
+	poolCache.count[i]++;
+}
+
+/*
+ * Object pools. Blocks are cache line aligned and carved from
+ * slabs of OBJSLABBLOCKS blocks. Blocks in a thread's cache are
+ * free, releasing a pool bumps its generation so the caches
+ * drop their stale blocks the next time they're used.
+ */
+
+#define CACHELINE 64
+#define OBJSLABBLOCKS 64
+#define OBJCACHESIZE 32
+
+bool32 objPoolThreadCaches = 1;
+
+struct ObjPool
+{
+	uint32 blockSize;
+	uint32 hint;	// of the objects, slabs are MEMDUR_GLOBAL
+	void *freeList;
+	void *slabs;
+	uint8 *top, *end;
+#ifndef RW_PS2
+	std::atomic<int32> numUsed;
+	std::atomic<uint32> generation;
+	std::mutex mutex;
+#else
+	int32 numUsed;
+	uint32 generation;
+#endif
+};
+static ObjPool objPools[NUM_OBJPOOLS];
+
+struct ObjPoolCache
+{
+	void *list[NUM_OBJPOOLS];
+	int32 count[NUM_OBJPOOLS];
+	uint32 generation[NUM_OBJPOOLS];
+
+	~ObjPoolCache(void){
+		for(int32 i = 0; i < NUM_OBJPOOLS; i++)
+			this->flush(i);
+	}
+	void check(int32 i);
+	void flush(int32 i);
+};
+static RWTHREADLOCAL ObjPoolCache objPoolCache;
+
+// Drop the blocks of a pool that was released since
+void
+ObjPoolCache::check(int32 i)
+{
+	uint32 gen = objPools[i].generation;
+	if(this->generation[i] != gen){
+		this->list[i] = nil;
+		this->count[i] = 0;
+		this->generation[i] = gen;
+	}
+}
+
+void
+ObjPoolCache::flush(int32 i)
+{
+	ObjPool *pool = &objPools[i];
+	void *p;
+	if(this->list[i] == nil)
+		return;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+	this->check(i);
+	while(p = this->list[i], p){
+		this->list[i] = *(void**)p;
+		*(void**)p = pool->freeList;
+		pool->freeList = p;
+	}
+	this->count[i] = 0;
+}
+
+static void
+releaseObjPool(ObjPool *pool)
+{
+	void *next;
+	for(void *s = pool->slabs; s; s = next){
+		next = *(void**)s;
+		rwFree(s);
+	}
+	pool->slabs = nil;
+	pool->freeList = nil;
+	pool->top = pool->end = nil;
+	pool->blockSize = 0;
+	pool->generation++;
+}
+
+void*
+objPoolAlloc(int32 type, int32 size, uint32 hint)
+{
+	ObjPool *pool = &objPools[type];
+	void *p;
+	objPoolCache.check(type);
+	// cached blocks are too small if plugins were registered since
+	if(pool->blockSize >= (uint32)size && (p = objPoolCache.list[type], p)){
+		objPoolCache.list[type] = *(void**)p;
+		objPoolCache.count[type]--;
+		pool->numUsed++;
+		return p;
+	}
+
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+	if(pool->blockSize < (uint32)size){
+		// plugins were registered since the last allocation
+		if(pool->numUsed != 0){
+			RWERROR((ERR_ALLOC, size));
+			return nil;
+		}
+		releaseObjPool(pool);
+		pool->blockSize = (size + CACHELINE-1) & ~(CACHELINE-1);
+		pool->hint = hint;
+	}
+	if(p = pool->freeList, p)
+		pool->freeList = *(void**)p;
+	else{
+		if(pool->top + pool->blockSize > pool->end){
+			uint8 *slab = rwMallocT(uint8, OBJSLABBLOCKS*pool->blockSize + 2*CACHELINE,
+				MEMDUR_GLOBAL | (hint & ~MEMDUR_MASK));
+			if(slab == nil)
+				return nil;
+			*(void**)slab = pool->slabs;
+			pool->slabs = slab;
+			pool->top = (uint8*)(((uintptr)slab + CACHELINE + CACHELINE-1) & ~(uintptr)(CACHELINE-1));
+			pool->end = pool->top + OBJSLABBLOCKS*pool->blockSize;
+		}
+		p = pool->top;
+		pool->top += pool->blockSize;
+	}
+	pool->numUsed++;
+	return p;
+}
+
+void
+objPoolFree(int32 type, void *p)
+{
+	ObjPool *pool = &objPools[type];
+	if(p == nil)
+		return;
+	objPoolCache.check(type);
+	if(objPoolThreadCaches && objPoolCache.count[type] < OBJCACHESIZE){
+		*(void**)p = objPoolCache.list[type];
+		objPoolCache.list[type] = p;
+		objPoolCache.count[type]++;
+		pool->numUsed--;
+		return;
+	}
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+	*(void**)p = pool->freeList;
+	pool->freeList = p;
+	pool->numUsed--;
+}
+
+void
+objPoolRelease(void)
+{
+	for(int32 i = 0; i < NUM_OBJPOOLS; i++){
+		ObjPool *pool = &objPools[i];
+		objPoolCache.flush(i);
+#ifndef RW_PS2
+		std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+		if(pool->numUsed == 0)
+			releaseObjPool(pool);
+	}
+}
+
+static void*
+hintedMalloc(size_t sz, uint32 hint)
+{
+	if(sz == 0)
+		return nil;
+	switch(hint & MEMDUR_MASK){
+	case MEMDUR_FUNCTION: return functionAlloc(sz);
+	case MEMDUR_FRAME: return frameAlloc(sz);
+	case MEMDUR_EVENT: return eventAlloc(sz);
+	default: return heapAlloc(sz);
+	}
+}
+
+static void
+hintedFree(void *p)
+{
+	if(p == nil)
+		return;
+	BlockHeader *b = BLOCKHEADER(p);
+	switch(b->type){
+	case BLOCK_HEAP: free(b); break;
+	case BLOCK_FUNCTION: functionFree((Arena*)b->owner); break;
+	case BLOCK_FRAME: break;
+	case BLOCK_POOL: eventFree((Pool*)b->owner, b); break;
+	case BLOCK_ALIGNED: hintedFree(b->owner); break;
+	}
+}
+
+// Blocks are as aligned as malloc's, for more
+// put another header in front of the aligned address.
+static void*
+hintedMallocAligned(size_t sz, uint32 align, uint32 hint)
+{
+	uint8 *p;
+	BlockHeader *b;
+	if(align <= 2*sizeof(void*))
+		return hintedMalloc(sz, hint);
+	p = (uint8*)hintedMalloc(sz + HEADERSIZE + align-1, hint);
+	if(p == nil)
+		return nil;
+	b = BLOCKHEADER(((uintptr)p + HEADERSIZE + align-1) & ~(uintptr)(align-1));
+	b->owner = p;
+	b->size = sz;
+	b->type = BLOCK_ALIGNED;
+	return BLOCKDATA(b);
+}
+
+static void*
+hintedRealloc(void *p, size_t sz, uint32 hint)
+{
+	if(p == nil)
+		return hintedMalloc(sz, hint);
+	if(sz == 0){
+		hintedFree(p);
+		return nil;
+	}
+	BlockHeader *b = BLOCKHEADER(p);
+	if(b->type == BLOCK_HEAP){
+		b = (BlockHeader*)realloc(b, sz + HEADERSIZE);
+		if(b == nil)
+			return nil;
+		b->size = sz;
+		return BLOCKDATA(b);
+	}
+	if(b->type == BLOCK_POOL && sz <= POOLBLOCKSIZE((Pool*)b->owner)){
+		b->size = sz;
+		return p;
+	}
+	void *newp = hintedMalloc(sz, hint);
+	if(newp == nil)
+		return nil;
+	memcpy(newp, p, sz < b->size ? sz : b->size);
+	hintedFree(p);
+	return newp;
+}
+
+MemoryFunctions hintedMemoryFunctions = {
+	hintedMalloc,
+	hintedRealloc,
+	hintedFree,
+	mustmalloc_h,
+	mustrealloc_h,
+	hintedMallocAligned,
+	hintedFree
+};
+
+/*
+ * Tracking. Each block gets a header with its size, hint and call
+ * site and is kept in a list of live blocks. Stats are kept per ID
+ * and duration with sums over both.
+ */
+
+struct TrackHeader
+{
+	TrackHeader *next;
+	TrackHeader *prev;
+	const char *file;
+	int32 line;
+	uint32 hint;
+	uint32 offset;	// from the block of the tracked functions
+	size_t size;
+};
+#define TRACKHEADERSIZE ALIGN16(sizeof(TrackHeader))
+#define TRACKHEADER(p) ((TrackHeader*)((uint8*)(p) - TRACKHEADERSIZE))
+#define TRACKDATA(t) ((void*)((uint8*)(t) + TRACKHEADERSIZE))
+
+#define NUMTRACKSLOTS 1024	// power of two
+
+static MemoryFunctions trackedFuncs = {
+	malloc_h,
+	realloc_h,
+	free,
+	mustmalloc_h,
+	mustrealloc_h
+};
+static MemoryStats trackSlots[NUMTRACKSLOTS];
+static int32 numTrackSlots;
+static TrackHeader liveBlocks = { &liveBlocks, &liveBlocks };
+#ifndef RW_PS2
+static std::mutex trackMutex;
+#endif
+
+// Call site of the allocation in progress, see mallocDebug
+struct MemSite
+{
+	const char *file;
+	int32 line;
+};
+static RWTHREADLOCAL MemSite memSite;
+
+static MemoryStats*
+findStats(uint32 id, uint32 duration, bool32 create)
+{
+	uint32 i = (id*2654435761u ^ duration) >> 16;
+	for(;; i++){
+		MemoryStats *st = &trackSlots[i & (NUMTRACKSLOTS-1)];
+		if(st->numAllocs == 0){
+			// keep one slot free so lookups terminate
+			if(!create || numTrackSlots == NUMTRACKSLOTS-1)
+				return nil;
+			numTrackSlots++;
+			st->id = id;
+			st->duration = duration;
+			return st;
+		}
+		if(st->id == id && st->duration == duration)
+			return st;
+	}
+}
+
+// blocks is 1 for an allocation and -1 for a free
+static void
+addStats(MemoryStats *st, size_t bytes, int32 blocks)
+{
+	if(st == nil)
+		return;
+	st->numBlocks += blocks;
+	if(blocks < 0){
+		st->bytes -= bytes;
+		return;
+	}
+	st->numAllocs++;
+	st->bytes += bytes;
+	if(st->bytes > st->peakBytes)
+		st->peakBytes = st->bytes;
+}
+
+static void
+addStats(uint32 hint, size_t bytes, int32 blocks)
+{
+	uint32 id = hint & ~MEMDUR_MASK;
+	uint32 dur = hint & MEMDUR_MASK;
+	addStats(findStats(id, dur, 1), bytes, blocks);
+	addStats(findStats(id, MEMSTATS_ALL, 1), bytes, blocks);
+	addStats(findStats(MEMSTATS_ALL, dur, 1), bytes, blocks);
+	addStats(findStats(MEMSTATS_ALL, MEMSTATS_ALL, 1), bytes, blocks);
+}
+
+static void
+trackBlock(TrackHeader *t)
+{
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(trackMutex);
+#endif
+	addStats(t->hint, t->size, 1);
+	t->next = liveBlocks.next;
+	t->prev = &liveBlocks;
+	liveBlocks.next->prev = t;
+	liveBlocks.next = t;
+}
+
+static void
+untrackBlock(TrackHeader *t)
+{
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(trackMutex);
+#endif
+	addStats(t->hint, t->size, -1);
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+}
+
+static void*
+trackingMalloc(size_t sz, uint32 hint)
+{
+	if(sz == 0)
+		return nil;
+	TrackHeader *t = (TrackHeader*)trackedFuncs.rwmalloc(sz + TRACKHEADERSIZE, hint);
+	if(t == nil)
+		return nil;
+	t->size = sz;
+	t->hint = hint;
+	t->offset = 0;
+	t->file = memSite.file;
+	t->line = memSite.line;
+	trackBlock(t);
+	return TRACKDATA(t);
+}
+
+static void*
+trackingMallocAligned(size_t sz, uint32 align, uint32 hint)
+{
+	if(sz == 0)
+		return nil;
+	if(align < 16)
+		align = 16;
+	uint8 *p = (uint8*)trackedFuncs.rwmalloc(sz + TRACKHEADERSIZE + align-1, hint);
+	if(p == nil)
+		return nil;
+	uint8 *data = (uint8*)(((uintptr)p + TRACKHEADERSIZE + align-1) & ~(uintptr)(align-1));
+	TrackHeader *t = TRACKHEADER(data);
+	t->size = sz;
+	t->hint = hint;
+	t->offset = (uint8*)t - p;
+	t->file = memSite.file;
+	t->line = memSite.line;
+	trackBlock(t);
+	return data;
+}
+
+static void
+trackingFree(void *p)
+{
+	if(p == nil)
+		return;
+	TrackHeader *t = TRACKHEADER(p);
+	untrackBlock(t);
+	trackedFuncs.rwfree((uint8*)t - t->offset);
+}
+
+static void*
+trackingRealloc(void *p, size_t sz, uint32 hint)
+{
+	if(p == nil)
+		return trackingMalloc(sz, hint);
+	if(sz == 0){
+		trackingFree(p);
+		return nil;
+	}
+	TrackHeader *t = TRACKHEADER(p);
+	TrackHeader *newt;
+	untrackBlock(t);
+	newt = (TrackHeader*)trackedFuncs.rwrealloc(t, sz + TRACKHEADERSIZE, hint);
+	if(newt == nil){
+		trackBlock(t);
+		return nil;
+	}
+	newt->size = sz;
+	newt->hint = hint;
+	if(memSite.file){
+		newt->file = memSite.file;
+		newt->line = memSite.line;
+	}
+	trackBlock(newt);
+	return TRACKDATA(newt);
+}
+
+MemoryFunctions trackingMemoryFunctions = {
+	trackingMalloc,
+	trackingRealloc,
+	trackingFree,
+	mustmalloc_h,
+	mustrealloc_h,
+	trackingMallocAligned,
+	trackingFree
+};
+
+void
+setTrackedMemoryFunctions(MemoryFunctions *funcs)
+{
+	trackedFuncs = *funcs;
+}
+
+bool32
+getMemoryStats(MemoryStats *stats, uint32 id, uint32 duration)
+{
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(trackMutex);
+#endif
+	MemoryStats *st = findStats(id, duration, 0);
+	if(st == nil){
+		memset(stats, 0, sizeof(MemoryStats));
+		stats->id = id;
+		stats->duration = duration;
+		return 0;
+	}
+	*stats = *st;
+	return 1;
+}
+
+static struct { uint32 id; const char *name; } idNames[] = {
+	{ 0, "untagged" },
+	{ ID_CAMERA, "Camera" },
+	{ ID_TEXTURE, "Texture" },
+	{ ID_MATERIAL, "Material" },
+	{ ID_WORLD, "World" },
+	{ ID_MATRIX, "Matrix" },
+	{ ID_FRAMELIST, "Frame" },
+	{ ID_GEOMETRY, "Geometry" },
+	{ ID_CLUMP, "Clump" },
+	{ ID_LIGHT, "Light" },
+	{ ID_ATOMIC, "Atomic" },
+	{ ID_TEXDICTIONARY, "TexDictionary" },
+	{ ID_IMAGE, "Image" },
+	{ ID_ANIMANIMATION, "Animation" },
+	{ ID_UVANIMDICT, "UVAnimDict" },
+	{ ID_SKIN, "Skin" },
+	{ ID_HANIM, "HAnim" },
+	{ ID_USERDATA, "UserData" },
+	{ ID_MATFX, "MatFX" },
+	{ ID_PDS, "PDS" },
+	{ ID_ADC, "ADC" },
+	{ ID_UVANIMATION, "UVAnim" },
+	{ ID_MESH, "Mesh" },
+	{ ID_NATIVEDATA, "NativeData" },
+	{ ID_VERTEXFMT, "VertexFormat" },
+	{ ID_RASTERGL, "RasterGL" },
+	{ ID_RASTERPS2, "RasterPS2" },
+	{ ID_RASTERXBOX, "RasterXbox" },
+	{ ID_RASTERD3D8, "RasterD3D8" },
+	{ ID_RASTERD3D9, "RasterD3D9" },
+	{ ID_RASTERWDGL, "RasterWDGL" },
+	{ ID_RASTERGL3, "RasterGL3" },
+	{ ID_DRIVER, "Driver" },
+	{ ID_CHUNKINDEX, "ChunkIndex" }
+};
+
+const char*
+getPluginIDName(uint32 id)
+{
+	for(uint32 i = 0; i < nelem(idNames); i++)
+		if(idNames[i].id == id)
+			return idNames[i].name;
+	return "";
+}
+
+static const char *durationNames[] = {
+	"NA", "FUNCTION", "FRAME", "EVENT", "GLOBAL"
+};
+
+static const char*
+getDurationName(uint32 hint)
+{
+	uint32 i = (hint & MEMDUR_MASK) >> 16;
+	return i < nelem(durationNames) ? durationNames[i] : "?";
+}
+
+static void
+printStats(const char *name, MemoryStats *st)
+{
+	printf("  %-10s %12llu %12llu %8d %10d\n", name,
+		(unsigned long long)st->bytes, (unsigned long long)st->peakBytes,
+		st->numBlocks, st->numAllocs);
+}
+
+static int
+cmpStatsID(const void *a, const void *b)
+{
+	uint32 ia = (*(MemoryStats**)a)->id;
+	uint32 ib = (*(MemoryStats**)b)->id;
+	return ia < ib ? -1 : ia > ib;
+}
+
+void
+printMemoryReport(void)
+{
+	MemoryStats *ids[NUMTRACKSLOTS];
+	MemoryStats *st;
+	int32 i, n;
+	uint32 d, dur;
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(trackMutex);
+#endif
+	n = 0;
+	for(i = 0; i < NUMTRACKSLOTS; i++)
+		if(trackSlots[i].numAllocs &&
+		   trackSlots[i].id != MEMSTATS_ALL &&
+		   trackSlots[i].duration == MEMSTATS_ALL)
+			ids[n++] = &trackSlots[i];
+	qsort(ids, n, sizeof(*ids), cmpStatsID);
+
+	printf("             %12s %12s %8s %10s\n", "bytes", "peak", "blocks", "allocs");
+	for(i = 0; i < n; i++){
+		printf("0x%08X %s\n", ids[i]->id, getPluginIDName(ids[i]->id));
+		for(d = 0; d < nelem(durationNames); d++){
+			dur = d << 16;
+			if(st = findStats(ids[i]->id, dur, 0), st)
+				printStats(durationNames[d], st);
+		}
+		printStats("all", ids[i]);
+	}
+	printf("total\n");
+	for(d = 0; d < nelem(durationNames); d++){
+		dur = d << 16;
+		if(st = findStats(MEMSTATS_ALL, dur, 0), st)
+			printStats(durationNames[d], st);
+	}
+	if(st = findStats(MEMSTATS_ALL, MEMSTATS_ALL, 0), st)
+		printStats("all", st);
+}
+
+
+void*
+mallocDebug(size_t sz, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	void *p = Engine::memfuncs.rwmalloc(sz, hint);
+	memSite.file = nil;
+	return p;
+}
+
+void*
+reallocDebug(void *p, size_t sz, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	p = Engine::memfuncs.rwrealloc(p, sz, hint);
+	memSite.file = nil;
+	return p;
+}
+
+void*
+mustmallocDebug(size_t sz, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	void *p = Engine::memfuncs.rwmustmalloc(sz, hint);
+	memSite.file = nil;
+	return p;
+}
+
+void*
+mustreallocDebug(void *p, size_t sz, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	p = Engine::memfuncs.rwmustrealloc(p, sz, hint);
+	memSite.file = nil;
+	return p;
+}
+
+void*
+mallocAlignedDebug(size_t sz, uint32 align, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	void *p = Engine::memfuncs.rwmallocaligned(sz, align, hint);
+	memSite.file = nil;
+	return p;
+}
+
+void*
+mustmallocAlignedDebug(size_t sz, uint32 align, uint32 hint, const char *file, int32 line)
+{
+	memSite.file = file;
+	memSite.line = line;
+	void *p = mustmallocAligned(sz, align, hint);
+	memSite.file = nil;
+	return p;
+}
+
+// Live blocks with the same ID, duration and call site
+struct LiveSite
+{
+	uint32 hint;
+	const char *file;
+	int32 line;
+	int32 numBlocks;
+	size_t bytes;
+};
+
+static int
+cmpLiveSite(const void *a, const void *b)
+{
+	const LiveSite *la = (const LiveSite*)a;
+	const LiveSite *lb = (const LiveSite*)b;
+	uint32 ia = la->hint & ~MEMDUR_MASK;
+	uint32 ib = lb->hint & ~MEMDUR_MASK;
+	if(ia != ib)
+		return ia < ib ? -1 : 1;
+	if(la->hint != lb->hint)
+		return la->hint < lb->hint ? -1 : 1;
+	if(la->file != lb->file)
+		return la->file == nil ? -1 : lb->file == nil ? 1 :
+			strcmp(la->file, lb->file);
+	return la->line - lb->line;
+}
+
+// Objects still in the pools, their slabs are MEMDUR_GLOBAL
+// and would hide them from Engine::close otherwise.
+static int32
+printLivePoolObjects(void)
+{
+	int32 i, numObjs, numUsed;
+	numObjs = 0;
+	for(i = 0; i < NUM_OBJPOOLS; i++){
+		ObjPool *pool = &objPools[i];
+		{
+#ifndef RW_PS2
+			std::lock_guard<std::mutex> lock(pool->mutex);
+#endif
+			numUsed = pool->numUsed;
+		}
+		if(numUsed == 0)
+			continue;
+		printf("0x%08X %s\n", pool->hint & ~MEMDUR_MASK,
+			getPluginIDName(pool->hint & ~MEMDUR_MASK));
+		printf("  %-8s %8d blocks %12llu bytes  object pool\n",
+			getDurationName(pool->hint), numUsed,
+			(unsigned long long)numUsed*pool->blockSize);
+		numObjs += numUsed;
+	}
+	return numObjs;
+}
+
+int32
+printLiveBlocks(bool32 global)
+{
+	TrackHeader *t;
+	LiveSite *sites;
+	int32 i, j, n, numBlocks, numObjs;
+	uint32 id, lastid;
+	size_t bytes;
+	// pool locks are taken before trackMutex
+	numObjs = printLivePoolObjects();
+#ifndef RW_PS2
+	std::lock_guard<std::mutex> lock(trackMutex);
+#endif
+	n = 0;
+	for(t = liveBlocks.next; t != &liveBlocks; t = t->next)
+		n++;
+	if(n == 0)
+		return numObjs;
+	// not with rwMalloc, we hold the lock
+	sites = (LiveSite*)malloc(n*sizeof(LiveSite));
+	if(sites == nil)
+		return numObjs;
+	i = 0;
+	for(t = liveBlocks.next; t != &liveBlocks; t = t->next){
+		if(!global && (t->hint & MEMDUR_MASK) == MEMDUR_GLOBAL)
+			continue;
+		sites[i].hint = t->hint;
+		sites[i].file = t->file;
+		sites[i].line = t->line;
+		sites[i].numBlocks = 1;
+		sites[i].bytes = t->size;
+		i++;
+	}
+	n = i;
+	qsort(sites, n, sizeof(LiveSite), cmpLiveSite);
+
+	// merge same sites
+	j = 0;
+	for(i = 0; i < n; i++){
+		if(j > 0 && cmpLiveSite(&sites[j-1], &sites[i]) == 0){
+			sites[j-1].numBlocks++;
+			sites[j-1].bytes += sites[i].bytes;
+		}else
+			sites[j++] = sites[i];
+	}
+	n = j;
+
+	numBlocks = 0;
+	bytes = 0;
+	lastid = MEMSTATS_ALL;
+	for(i = 0; i < n; i++){
+		id = sites[i].hint & ~MEMDUR_MASK;
+		if(id != lastid)
+			printf("0x%08X %s\n", id, getPluginIDName(id));
+		lastid = id;
+		printf("  %-8s %8d blocks %12llu bytes  %s:%d\n",
+			getDurationName(sites[i].hint),
+			sites[i].numBlocks, (unsigned long long)sites[i].bytes,
+			sites[i].file ? sites[i].file : "?", sites[i].line);
+		numBlocks += sites[i].numBlocks;
+		bytes += sites[i].bytes;
+	}
+	if(numBlocks)
+		printf("%d blocks with %llu bytes still allocated\n",
+			numBlocks, (unsigned long long)bytes);
+	free(sites);
+	return numBlocks + numObjs;
+}
+
+}
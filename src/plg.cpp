@@ -14,6 +14,9 @@
 
 namespace rw {
 
+#define CACHELINESIZE 64
+#define ALIGNPLG(x, a) (((x) + (a)-1) & ~((a)-1))
+
 static void *defCtor(void *object, int32, int32) { return object; }
 static void *defDtor(void *object, int32, int32) { return object; }
 static void *defCopy(void *dst, void*, int32, int32) { return dst; }
@@ -21,22 +24,28 @@ static void *defCopy(void *dst, void*, int32, int32) { return dst; }
 void
 PluginList::construct(void *object)
 {
-	for(Plugin *p = this->first; p; p = p->next)
+	for(int32 i = 0; i < this->numCtors; i++){
+		Plugin *p = this->ctors[i];
 		p->constructor(object, p->offset, p->size);
+	}
 }
 
 void
 PluginList::destruct(void *object)
 {
-	for(Plugin *p = this->first; p; p = p->next)
+	for(int32 i = 0; i < this->numDtors; i++){
+		Plugin *p = this->dtors[i];
 		p->destructor(object, p->offset, p->size);
+	}
 }
 
 void
 PluginList::copy(void *dst, void *src)
 {
-	for(Plugin *p = this->first; p; p = p->next)
+	for(int32 i = 0; i < this->numCopies; i++){
+		Plugin *p = this->copies[i];
 		p->copy(dst, src, p->offset, p->size);
+	}
 }
 
 bool
@@ -50,14 +59,12 @@ PluginList::streamRead(Stream *stream, void *object)
 		if(!readChunkHeaderInfo(stream, &header))
 			return false;
 		length -= 12;
-		for(Plugin *p = this->first; p; p = p->next)
-			if(p->id == header.type && p->read){
-				p->read(stream, header.length,
-				        object, p->offset, p->size);
-				goto cont;
-			}
-		stream->seek(header.length);
-cont:
+		Plugin *p = this->find(header.type);
+		if(p && p->read)
+			p->read(stream, header.length,
+			        object, p->offset, p->size);
+		else
+			stream->seek(header.length);
 		length -= header.length;
 	}
 	return true;
@@ -66,15 +73,17 @@ cont:
 void
 PluginList::streamWrite(Stream *stream, void *object)
 {
-	int size = this->streamGetSize(object);
-	writeChunkHeader(stream, ID_EXTENSION, size);
+	int32 size = needChunkSize() ? this->streamGetSize(object) : 0;
+	uint32 start = beginChunk(stream, ID_EXTENSION, size);
 	for(Plugin *p = this->first; p; p = p->next){
+		int32 plgsize;
 		if(p->getSize == nil ||
-		   (size = p->getSize(object, p->offset, p->size)) <= 0)
+		   (plgsize = p->getSize(object, p->offset, p->size)) <= 0)
 			continue;
-		writeChunkHeader(stream, p->id, size);
-		p->write(stream, size, object, p->offset, p->size);
+		writeChunkHeader(stream, p->id, plgsize);
+		p->write(stream, plgsize, object, p->offset, p->size);
 	}
+	endChunk(stream, start, size);
 }
 
 int
@@ -107,28 +116,148 @@ PluginList::streamSkip(Stream *stream)
 void
 PluginList::assertRights(void *object, uint32 pluginID, uint32 data)
 {
-	for(Plugin *p = this->first; p; p = p->next)
-		if(p->id == pluginID){
-			if(p->rightsCallback)
-				p->rightsCallback(object,
-				                  p->offset, p->size, data);
-			return;
+	Plugin *p = this->find(pluginID);
+	if(p && p->rightsCallback)
+		p->rightsCallback(object, p->offset, p->size, data);
+}
+
+static PluginList *pluginLists;
+
+void
+PluginList::freeAll(void)
+{
+	PluginList *l, *next;
+	Plugin *p, *pnext;
+	for(l = pluginLists; l; l = next){
+		next = l->nextList;
+		for(p = l->first; p; p = pnext){
+			pnext = p->next;
+			rwFree(p);
+		}
+		rwFree(l->ctors);
+		rwFree(l->table);
+		l->size = l->defaultSize;
+		l->first = nil;
+		l->last = nil;
+		l->hotReserve = 0;
+		l->hotEnd = 0;
+		l->coldStart = 0;
+		l->table = nil;
+		l->tableMask = 0;
+		l->ctors = l->dtors = l->copies = nil;
+		l->numCtors = l->numDtors = l->numCopies = 0;
+		l->nextList = nil;
+	}
+	pluginLists = nil;
+}
+
+static uint32
+hashPluginID(uint32 id)
+{
+	return id * 2654435761u >> 16;
+}
+
+// Plugins are only registered at startup, so it's fine to
+// build everything again every time.
+void
+PluginList::update(void)
+{
+	Plugin *p;
+	uint32 n = 0;
+	for(p = this->first; p; p = p->next)
+		n++;
+
+	// Leave out the default (no-op) callbacks
+	rwFree(this->ctors);
+	this->ctors = rwNewT(Plugin*, 3*n, MEMDUR_GLOBAL);
+	this->dtors = this->ctors + n;
+	this->copies = this->dtors + n;
+	this->numCtors = 0;
+	this->numDtors = 0;
+	this->numCopies = 0;
+	for(p = this->first; p; p = p->next){
+		if(p->constructor != defCtor)
+			this->ctors[this->numCtors++] = p;
+		if(p->destructor != defDtor)
+			this->dtors[this->numDtors++] = p;
+		if(p->copy != defCopy)
+			this->copies[this->numCopies++] = p;
+	}
+
+	uint32 sz = 8;
+	while(sz < 2*n)
+		sz *= 2;
+	rwFree(this->table);
+	this->table = rwNewT(Plugin*, sz, MEMDUR_GLOBAL);
+	memset(this->table, 0, sz*sizeof(Plugin*));
+	this->tableMask = sz-1;
+	for(p = this->first; p; p = p->next){
+		uint32 h = hashPluginID(p->id) & this->tableMask;
+		while(this->table[h]){
+			// first one wins as with a linear search
+			if(this->table[h]->id == p->id)
+				goto next;
+			h = (h+1) & this->tableMask;
 		}
+		this->table[h] = p;
+	next:;
+	}
+}
+
+Plugin*
+PluginList::find(uint32 id)
+{
+	if(this->table == nil)
+		return nil;
+	uint32 h = hashPluginID(id) & this->tableMask;
+	Plugin *p;
+	while(p = this->table[h], p){
+		if(p->id == id)
+			return p;
+		h = (h+1) & this->tableMask;
+	}
+	return nil;
 }
 
 
 int32
 PluginList::registerPlugin(int32 size, uint32 id,
-	Constructor ctor, Destructor dtor, CopyConstructor copy)
+	Constructor ctor, Destructor dtor, CopyConstructor copy, uint32 flags)
 {
 	Plugin *p = (Plugin*)rwMalloc(sizeof(Plugin), MEMDUR_GLOBAL);
-	p->offset = this->size;
-	this->size += size;
-	int32 round = sizeof(void*)-1;
-	this->size = (this->size + round)&~round;
+	int32 align = flags & PLUGINALIGNMASK;
+	if(align < (int32)sizeof(void*))
+		align = sizeof(void*);
+	if(this->hotEnd == 0)
+		this->hotEnd = this->defaultSize;
+
+	if(size == 0)
+		// takes no space, don't let it fix the layout
+		p->offset = this->size;
+	else if(flags & PLUGINHOT &&
+	        (this->coldStart == 0 ||
+	         ALIGNPLG(this->hotEnd, align) + size <= this->coldStart)){
+		p->offset = ALIGNPLG(this->hotEnd, align);
+		this->hotEnd = p->offset + size;
+		if(this->coldStart == 0)
+			this->size = this->hotEnd;
+	}else{
+		// the first cold plugin leaves the reserved space to hot ones
+		if(this->coldStart == 0){
+			int32 start = this->defaultSize + this->hotReserve;
+			if(start > this->size)
+				this->size = ALIGNPLG(start, (int32)sizeof(void*));
+			this->coldStart = this->size;
+		}
+		p->offset = ALIGNPLG(this->size, align);
+		this->size = p->offset + size;
+		flags &= ~PLUGINHOT;
+	}
+	this->size = ALIGNPLG(this->size, (int32)sizeof(void*));
 
 	p->size = size;
 	p->id = id;
+	p->flags = flags;
 	p->constructor = ctor ? ctor : defCtor;
 	p->destructor = dtor ? dtor : defDtor;
 	p->copy = copy ? copy : defCopy;
@@ -142,11 +271,14 @@ PluginList::registerPlugin(int32 size, uint32 id,
 	if(this->first == nil){
 		this->first = p;
 		this->last = p;
+		this->nextList = pluginLists;
+		pluginLists = this;
 	}else{
 		this->last->next = p;
 		p->prev = this->last;
 		this->last = p;
 	}
+	this->update();
 	return p->offset;
 }
 
@@ -154,34 +286,70 @@ int32
 PluginList::registerStream(uint32 id,
 	StreamRead read, StreamWrite write, StreamGetSize getSize)
 {
-	for(Plugin *p = this->first; p; p = p->next)
-		if(p->id == id){
-			p->read = read;
-			p->write = write;
-			p->getSize = getSize;
-			return p->offset;
-		}
-	return -1;
+	Plugin *p = this->find(id);
+	if(p == nil)
+		return -1;
+	p->read = read;
+	p->write = write;
+	p->getSize = getSize;
+	return p->offset;
 }
 
 int32
 PluginList::setStreamRightsCallback(uint32 id, RightsCallback cb)
 {
-	for(Plugin *p = this->first; p; p = p->next)
-		if(p->id == id){
-			p->rightsCallback = cb;
-			return p->offset;
-		}
-	return -1;
+	Plugin *p = this->find(id);
+	if(p == nil)
+		return -1;
+	p->rightsCallback = cb;
+	return p->offset;
 }
 
 int32
 PluginList::getPluginOffset(uint32 id)
 {
-	for(Plugin *p = this->first; p; p = p->next)
-		if(p->id == id)
-			return p->offset;
-	return -1;
+	Plugin *p = this->find(id);
+	return p ? p->offset : -1;
+}
+
+void
+PluginList::dumpLayout(const char *name)
+{
+	Plugin *p, *next;
+	int32 off = -1;
+	printf("%s: %d bytes, %d cache lines, base %d bytes\n", name, this->size,
+		ALIGNPLG(this->size, CACHELINESIZE)/CACHELINESIZE, this->defaultSize);
+	// in order of offset
+	for(;;){
+		next = nil;
+		for(p = this->first; p; p = p->next)
+			if(p->size && p->offset > off &&
+			   (next == nil || p->offset < next->offset))
+				next = p;
+		if(next == nil)
+			break;
+		p = next;
+		off = p->offset;
+		printf("  %5d %5d  %-14s %08X line %d%s\n", p->offset, p->size,
+			getPluginIDName(p->id), p->id, p->offset/CACHELINESIZE,
+			p->flags & PLUGINHOT ? " hot" : "");
+	}
+}
+
+void
+dumpPluginLayouts(void)
+{
+	Frame::s_plglist.dumpLayout("Frame");
+	Camera::s_plglist.dumpLayout("Camera");
+	Light::s_plglist.dumpLayout("Light");
+	Raster::s_plglist.dumpLayout("Raster");
+	Texture::s_plglist.dumpLayout("Texture");
+	TexDictionary::s_plglist.dumpLayout("TexDictionary");
+	Material::s_plglist.dumpLayout("Material");
+	Geometry::s_plglist.dumpLayout("Geometry");
+	Atomic::s_plglist.dumpLayout("Atomic");
+	Clump::s_plglist.dumpLayout("Clump");
+	World::s_plglist.dumpLayout("World");
 }
 
 }
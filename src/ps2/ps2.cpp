@@ -731,7 +731,7 @@ MatPipeline::collectData(Geometry *g, InstanceData *inst, Mesh *m, uint8 *data[]
 	PipeAttribute *a;
 	InstMeshInfo im = getInstMeshInfo(this, g, m);
 
-	uint8 *raw = rwNewT(uint8, im.vertexSize*m->numIndices, MEMDUR_EVENT | ID_GEOMETRY);
+	uint8 *raw = rwFrameNewT(uint8, im.vertexSize*m->numIndices);
 	uint8 *dp = raw;
 	for(uint i = 0; i < nelem(this->attribs); i++)
 		if(a = this->attribs[i])
@@ -849,8 +849,9 @@ objUninstance(rw::ObjPipeline *rwpipe, Atomic *atomic)
 	geo->numTriangles = geo->meshHeader->guessNumTriangles();
 	geo->allocateData();
 	geo->allocateMeshes(geo->meshHeader->numMeshes, geo->meshHeader->totalIndices, 0);
-	uint32 *flags = rwNewT(uint32, geo->numVertices,
-		MEMDUR_FUNCTION | ID_GEOMETRY);
+	FrameAllocator *fa = FrameAllocator::get();
+	FrameAllocator::Mark mark = fa->getMark();
+	uint32 *flags = rwFrameNewT(uint32, geo->numVertices);
 	memset(flags, 0, 4*geo->numVertices);
 	memset(geo->meshHeader->getMeshes()->indices, 0, 2*geo->meshHeader->totalIndices);
 	for(uint32 i = 0; i < header->numMeshes; i++){
@@ -874,10 +875,9 @@ objUninstance(rw::ObjPipeline *rwpipe, Atomic *atomic)
 
 		//printDMAVIF(instance);
 		uint8 *data[nelem(m->attribs)] = { nil };
-		uint8 *raw = m->collectData(geo, instance, mesh, data);
+		m->collectData(geo, instance, mesh, data);
 		assert(m->uninstanceCB);
 		m->uninstanceCB(m, geo, flags, mesh, data);
-		rwFree(raw);
 	}
 	for(uint32 i = 0; i < header->numMeshes; i++){
 		Mesh *mesh = &geo->meshHeader->getMeshes()[i];
@@ -891,7 +891,7 @@ objUninstance(rw::ObjPipeline *rwpipe, Atomic *atomic)
 
 	int8 *bits = getADCbits(geo);
 	geo->generateTriangles(bits);
-	rwFree(flags);
+	fa->release(&mark);
 	geo->flags &= ~Geometry::NATIVE;
 	destroyNativeData(geo, 0, 0);
 /*
@@ -1172,7 +1172,7 @@ unconvertADC(Geometry *g)
 		newm++;
 		oldm++;
 	}
-	rwFree(oldmh);
+	g->freeData(oldmh);
 	adc->adcFormatted = 0;
 	rwFree(adc->adcBits);
 	adc->adcBits = nil;
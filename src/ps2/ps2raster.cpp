@@ -81,27 +81,6 @@ transferMinSize(int32 psm, int32 flags, int32 *minw, int32 *minh)
 #define ALIGN64(x) ((x) + 0x3F & ~0x3F)
 #define NSIZE(dim,pagedim) (((dim) + (pagedim)-1)/(pagedim))
 
-void*
-mallocalign(size_t size, int32 alignment)
-{
-	void *p;
-	void **pp;
-	p = rwMalloc(size + alignment + sizeof(void*), MEMDUR_EVENT | ID_RASTERPS2);
-	if(p == nil) return nil;
-	pp = (void**)(((uintptr)p + sizeof(void*) + alignment)&~(alignment-1));
-	pp[-1] = p;
-	return (void*)pp;
-}
-
-void
-freealign(void *p)
-{
-	void *pp;
-	if(p == nil) return;
-	pp = ((void**)p)[-1];
-	rwFree(pp);
-}
-
 // TODO: these depend on video mode, set in deviceSystem!
 int32 cameraFormat = Raster::C8888;
 int32 cameraDepth = 32;
@@ -1025,7 +1004,7 @@ createTexRaster(Raster *raster)
 	if(noNewStyleRasters ||
 	   (raster->width*raster->height*raster->depth/8/0x10) >= 0x7FFF){
 		ras->dataSize = ras->paletteSize+ras->pixelSize;
-		uint8 *data = (uint8*)mallocalign(ras->dataSize, 0x40);
+		uint8 *data = (uint8*)rwMallocAligned(ras->dataSize, 0x40, MEMDUR_EVENT | ID_RASTERPS2);
 		assert(data);
 		ras->data = data;
 		raster->pixels = data;
@@ -1114,7 +1093,7 @@ createTexRaster(Raster *raster)
 			ras->dataSize = ALIGN(ras->pixelSize,128) + ALIGN(ras->paletteSize,64) + extrasize + 0x70;
 		else
 			ras->dataSize = ALIGN(ras->paletteSize+ras->pixelSize,64) + extrasize + 0x70;
-		uint8 *data = (uint8*)mallocalign(ras->dataSize, 0x40);
+		uint8 *data = (uint8*)rwMallocAligned(ras->dataSize, 0x40, MEMDUR_EVENT | ID_RASTERPS2);
 		uint32 *xferchain = (uint32*)(data + 0x10);
 		assert(data);
 		ras->data = data;
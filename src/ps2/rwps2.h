@@ -109,6 +109,7 @@ public:
 	void dump(void);
 	void setTriBufferSizes(uint32 inputStride, uint32 bufferSize);
 	void instance(Geometry *g, InstanceData *inst, Mesh *m);
+	// non-RW attribs are copied to FrameAllocator memory
 	uint8 *collectData(Geometry *g, InstanceData *inst, Mesh *m, uint8 *data[]);
 };
 
@@ -170,7 +170,7 @@ struct UVAnimDictionary
 	uint32 streamGetSize(void);
 };
 
-extern UVAnimDictionary *currentUVAnimDictionary;
+extern RWTHREADLOCAL UVAnimDictionary *currentUVAnimDictionary;
 
 // Material plugin
 struct UVAnim
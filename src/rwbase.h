@@ -29,6 +29,13 @@
 #define RW_OPENGL
 #endif
 
+// No threads on PS2
+#ifdef RW_PS2
+#define RWTHREADLOCAL
+#else
+#define RWTHREADLOCAL thread_local
+#endif
+
 namespace rw {
 
 #ifdef RW_PS2
@@ -285,6 +292,7 @@ struct RawMatrix
 
 	static void mult(RawMatrix *dst, RawMatrix *src1, RawMatrix *src2);
 	static void transpose(RawMatrix *dst, RawMatrix *src);
+	static void transposeArray(RawMatrix *dst, RawMatrix *src, int32 n);
 	static void setIdentity(RawMatrix *dst);
 };
 
@@ -318,9 +326,22 @@ struct Matrix
 	void destroy(void);
 	void setIdentity(void);
 	void optimize(Tolerance *tolerance = nil);
+	// Only checks for identity, for matrices the caller
+	// knows to be orthonormal, e.g. animation output
+	void optimizeOrthonormal(Tolerance *tolerance = nil);
 	void update(void) { flags &= ~(IDENTITY|TYPEMASK); }
 	static Matrix *mult(Matrix *dst, const Matrix *src1, const Matrix *src2);
+	// dst[i] = src1[i]*src2[i], dst must not overlap the sources
+	static void multArray(Matrix *dst, const Matrix *src1, const Matrix *src2, int32 n);
+	// dst[i] = src1[i]*src2, same restriction
+	static void multArrayByOne(Matrix *dst, const Matrix *src1, const Matrix *src2, int32 n);
+	// dst[i] = parent*local[i] where parent is dst[parents[i]],
+	// or root if parents[i] < 0 (nil for identity).
+	// Parents have to come before their children.
+	static void multHierarchy(Matrix *dst, const Matrix *local, const int32 *parents, int32 n, const Matrix *root);
 	static Matrix *invert(Matrix *dst, const Matrix *src);
+	// dst[i] = inverse of src[i], dst must not overlap src
+	static void invertArray(Matrix *dst, const Matrix *src, int32 n);
 	static Matrix *transpose(Matrix *dst, const Matrix *src);
 	Matrix *rotate(V3d *axis, float32 angle, CombineOp op);
 	Matrix *rotate(const Quat &q, CombineOp op);
@@ -342,9 +363,12 @@ private:
 	float32 identityError(void);
 };
 
-inline void convMatrix(Matrix *dst, RawMatrix *src){
+inline void convMatrix(Matrix *dst, RawMatrix *src, bool32 orthonormal = 0){
 	*dst = *(Matrix*)src;
-	dst->optimize();
+	if(orthonormal)
+		dst->optimizeOrthonormal();
+	else
+		dst->optimize();
 }
 
 inline void convMatrix(RawMatrix *dst, Matrix *src){
@@ -411,11 +435,17 @@ class Stream
 {
 public:
 	virtual void close(void) = 0;
+	// both return the number of bytes transferred
 	virtual uint32 write(const void *data, uint32 length) = 0;
 	virtual uint32 read(void *data, uint32 length) = 0;
 	virtual void seek(int32 offset, int32 whence = 1) = 0;
 	virtual uint32 tell(void) = 0;
 	virtual bool eof(void) = 0;
+	// Returns a pointer to the next 'length' bytes of the stream and
+	// skips over them. Only streams that keep their data in memory
+	// can do this, everything else returns nil and the caller
+	// has to read into a buffer of its own.
+	virtual uint8 *getData(uint32 length) { return nil; }
 	int32   writeI8(int8 val);
 	int32   writeU8(uint8 val);
 	int32   writeI16(int16 val);
@@ -445,6 +475,7 @@ public:
 	void seek(int32 offset, int32 whence = 1);
 	uint32 tell(void);
 	bool eof(void);
+	uint8 *getData(uint32 length);
 	StreamMemory *open(uint8 *data, uint32 length, uint32 capacity = 0);
 	uint32 getLength(void);
 
@@ -456,15 +487,45 @@ public:
 class StreamFile : public Stream
 {
 	FILE *file;
+	// Optional read-ahead/write-behind buffer, see open().
+	// It holds the file contents from bufferStart to bufferStart+bufferFill.
+	uint8 *buffer;
+	uint32 bufferSize;
+	uint32 bufferStart;
+	uint32 bufferPos;
+	uint32 bufferFill;
+	uint32 filePos;		// position of the underlying FILE
+	bool32 bufferDirty;
+	bool32 bufferEOF;
+
+	void flushBuffer(void);
+	void seekFile(uint32 pos);
 public:
-	StreamFile(void) { file = nil; }
+	StreamFile(void) { file = nil; buffer = nil; }
 	void close(void);
 	uint32 write(const void *data, uint32 length);
 	uint32 read(void *data, uint32 length);
 	void seek(int32 offset, int32 whence = 1);
 	uint32 tell(void);
 	bool eof(void);
-	StreamFile *open(const char *path, const char *mode);
+	// With a bufferSize, reads and writes go through a buffer of that
+	// size and seeks that stay inside it don't touch the file at all.
+	StreamFile *open(const char *path, const char *mode, uint32 bufferSize = 0);
+};
+
+// Read-only stream over a whole file mapped into memory.
+// Data returned by getData points straight into the mapping
+// and is valid until the stream is closed.
+class StreamMapped : public StreamMemory
+{
+	uint8 *base;
+	uint32 size;
+	void *handle;
+public:
+	StreamMapped(void) { base = nil; size = 0; handle = nil; }
+	void close(void);
+	uint32 write(const void *data, uint32 length);
+	StreamMapped *open(const char *path);
 };
 
 enum Platform
@@ -503,7 +564,9 @@ enum VendorID
 	// Used for rasters (platform-specific)
 	VEND_RASTER         = 10,
 	// Used for driver/device allocation tags
-	VEND_DRIVER         = 11
+	VEND_DRIVER         = 11,
+	// Used for chunks only librw reads and writes
+	VEND_LIBRW          = 12
 };
 
 // TODO: modules (VEND_CRITERIONINT)
@@ -559,7 +622,10 @@ enum PluginID
 	ID_RASTERGL3     = MAKEPLUGINID(VEND_RASTER, PLATFORM_GL3),
 
 	// anything driver/device related (only as allocation tag)
-	ID_DRIVER        = MAKEPLUGINID(VEND_DRIVER, 0)
+	ID_DRIVER        = MAKEPLUGINID(VEND_DRIVER, 0),
+
+	// librw's own chunks
+	ID_CHUNKINDEX    = MAKEPLUGINID(VEND_LIBRW, 0x01)
 };
 
 enum CoreModuleID
@@ -579,12 +645,59 @@ enum Errors
 
 #undef ECODE
 
-extern int32 version;
-extern int32 build;
+// version and build are per thread, see StreamContext
+extern RWTHREADLOCAL int32 version;
+extern RWTHREADLOCAL int32 build;
 extern int32 platform;
 extern bool32 streamAppendFrames;
+// Write chunks in a single pass and patch in their sizes afterwards
+// instead of calculating them up front. Needs a seekable stream.
+extern bool32 streamSinglePass;
+// Calculate sizes anyway and report chunks that don't match
+extern bool32 streamCheckSizes;
+// Let geometry read from memory point into the stream's buffer
+// instead of copying. The buffer has to outlive the geometry,
+// Geometry::lock makes a private copy.
+extern bool32 streamBorrowGeometry;
+// Decode geometry lists on this many threads. Plugin constructors
+// of geometries have to be thread safe then. Only worth it with
+// free cores, threads just add overhead on a single one.
+extern int32 streamLoadThreads;
+// Decode texture dictionaries on this many threads.
+// Rasters are created on those threads, so the raster
+// driver of the texture's platform has to allow that.
+extern int32 streamTextureThreads;
 extern char *debugFile;
 
+struct TexDictionary;
+struct UVAnimDictionary;
+
+// The state stream readers and writers depend on.
+// Every thread has its own so threads can load different
+// files at the same time. New threads start out with the
+// defaults (and no current texture dictionary),
+// use this to hand over the state of another thread.
+// The dictionaries aren't owned and have to outlive the context.
+struct StreamContext
+{
+	int32 version;
+	int32 build;
+	TexDictionary *texDict;
+	UVAnimDictionary *uvAnimDict;
+
+	void getCurrent(void);
+	void setCurrent(void);
+};
+
+// Call func(data, i) for every i < numJobs on up to numThreads
+// threads, the calling one included. Returns when all are done.
+// Jobs run with the caller's StreamContext and the first RWERROR
+// of another thread is set on the calling one afterwards.
+// Always serial on PS2.
+void runJobs(int32 numThreads, int32 numJobs, void (*func)(void *data, int32 i), void *data);
+// Join the threads runJobs keeps around, done by Engine::close
+void stopJobThreads(void);
+
 int strcmp_ci(const char *s1, const char *s2);
 int strncmp_ci(const char *s1, const char *s2, int n);
 
@@ -633,9 +746,50 @@ struct ChunkHeaderInfo
 
 // TODO?: make these methods of ChunkHeaderInfo?
 bool writeChunkHeader(Stream *s, int32 type, int32 size);
+// Chunks whose size may be patched in later, see streamSinglePass.
+// Only calculate the size if needChunkSize() is true.
+inline bool32 needChunkSize(void) { return !streamSinglePass || streamCheckSizes; }
+uint32 beginChunk(Stream *s, int32 type, int32 size);
+void endChunk(Stream *s, uint32 start, int32 size);
 bool readChunkHeaderInfo(Stream *s, ChunkHeaderInfo *header);
 bool findChunk(Stream *s, uint32 type, uint32 *length, uint32 *version);
 
+// Table of contents of a stream. Records where every chunk and
+// nested chunk is so readers can seek to them directly.
+// Offsets are relative to where the indexed data starts, which is
+// base in the stream being read. build() sets it to where it started,
+// streamRead() to the end of the index, i.e. the data is expected to
+// follow the index. Set it yourself if it's somewhere else.
+struct ChunkIndex
+{
+	struct Entry {
+		uint32 type;
+		uint32 length;
+		uint32 version, build;
+		uint32 offset;		// of the data, after the header, from base
+		int32 parent;		// index of the enclosing chunk or -1
+		char name[32];		// texture name for ID_TEXTURE(NATIVE)
+	};
+	Entry *entries;
+	int32 numEntries;
+	int32 space;
+	uint32 base;
+
+	static ChunkIndex *create(void);
+	void destroy(void);
+	bool32 build(Stream *stream);
+	int32 find(uint32 type, int32 n = 0);
+	int32 findChild(int32 parent, uint32 type, int32 n = 0);
+	int32 findTexture(const char *name);
+	bool32 seek(Stream *stream, int32 i);
+	static ChunkIndex *streamRead(Stream *stream);
+	bool streamWrite(Stream *stream);
+	uint32 streamGetSize(void);
+
+	// helper function. consider private
+	int32 addEntry(ChunkHeaderInfo *header, uint32 offset, int32 parent);
+};
+
 int32 findPointer(void *p, void **list, int32 num);
 uint8 *getFileContents(char *name, uint32 *len);
 }
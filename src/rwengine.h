@@ -85,7 +85,10 @@ enum MemHint
 	// used for longer time
 	MEMDUR_EVENT = 0x30000,
 	// used while the engine is running
-	MEMDUR_GLOBAL = 0x40000
+	MEMDUR_GLOBAL = 0x40000,
+
+	// the rest is the ID of the allocating object or plugin
+	MEMDUR_MASK = 0xF0000
 };
 
 struct MemoryFunctions
@@ -97,7 +100,91 @@ struct MemoryFunctions
 	// TODO: Maybe don't put them here since they shouldn't really be switched out
 	void *(*rwmustmalloc)(size_t sz, uint32 hint);
 	void *(*rwmustrealloc)(void *p, size_t sz, uint32 hint);
+	// align is a power of two. Blocks can't be realloc'ed.
+	// Engine::init sets these from rwmalloc and rwfree if they're nil.
+	void *(*rwmallocaligned)(size_t sz, uint32 align, uint32 hint);
+	void  (*rwfreealigned)(void *p);
+};
+
+// Allocators that make use of the duration, pass to Engine::init.
+// MEMDUR_FUNCTION memory comes from a per thread arena that is
+// rewound once all blocks in it are freed. Once the arena has
+// grown to 1MB without being rewound, the heap is used.
+// MEMDUR_FRAME memory comes from the FrameAllocator of the thread,
+// rwFree does nothing on it.
+// Small MEMDUR_EVENT blocks come from size class pools.
+extern MemoryFunctions hintedMemoryFunctions;
+
+// Linear allocator for scratch memory that lives until the next frame.
+// Every thread has its own, all of them are rewound by resetFrameMemory(),
+// which Camera::beginUpdate calls. Code that runs outside of camera
+// updates (tools, converters) should release to a mark instead.
+// Memory of a thread goes away with it.
+struct FrameAllocator
+{
+	struct Mark {
+		void *chunk;
+		uint8 *top;
+		void *large;
+	};
+	// 16 byte aligned, nil if out of memory
+	void *alloc(size_t sz);
+	// grows in place if p was the last allocation, copies otherwise
+	void *resize(void *p, size_t oldSz, size_t newSz);
+	Mark getMark(void);
+	// free everything allocated since mark was taken in this frame
+	void release(Mark *mark);
+
+	// the allocator of the current thread
+	static FrameAllocator *get(void);
 };
+#define rwFrameNewT(t, s) (t*)rw::FrameAllocator::get()->alloc((s)*sizeof(t))
+// Start a new frame for the FrameAllocators of all threads
+void resetFrameMemory(void);
+
+// Pools of cache line aligned blocks for objects that are created a lot.
+// The block size is set by the first allocation, so plugins can only
+// be registered later while no object of that type exists.
+enum ObjPoolType
+{
+	OBJPOOL_FRAME,
+	OBJPOOL_ATOMIC,
+	OBJPOOL_MATERIAL,
+	OBJPOOL_TEXTURE,
+	NUM_OBJPOOLS
+};
+void *objPoolAlloc(int32 type, int32 size, uint32 hint);
+void objPoolFree(int32 type, void *p);
+// Free the memory of pools with no objects left, done by Engine::term
+void objPoolRelease(void);
+// Keep some freed blocks per thread to avoid locking
+extern bool32 objPoolThreadCaches;
+
+// Allocation statistics by ID and duration, pass
+// trackingMemoryFunctions to Engine::init to collect them.
+// Blocks come from the tracked functions, malloc by default.
+// Object pools are counted by their slabs.
+#define MEMSTATS_ALL 0xFFFFFFFF
+struct MemoryStats
+{
+	uint32 id;		// PluginID of the hint or MEMSTATS_ALL
+	uint32 duration;	// MEMDUR_* or MEMSTATS_ALL
+	size_t bytes;
+	size_t peakBytes;
+	int32 numBlocks;
+	int32 numAllocs;	// since start
+};
+extern MemoryFunctions trackingMemoryFunctions;
+void setTrackedMemoryFunctions(MemoryFunctions *funcs);
+bool32 getMemoryStats(MemoryStats *stats, uint32 id, uint32 duration);
+// Table of bytes in use by ID and duration on stdout
+void printMemoryReport(void);
+// List blocks that are still allocated by ID and call site.
+// Engine::close lists all but MEMDUR_GLOBAL ones, Engine::term all.
+// Objects left in the object pools are listed too.
+// Call sites are only known when compiled with RW_MEMDEBUG.
+int32 printLiveBlocks(bool32 global);
+const char *getPluginIDName(uint32 id);
 
 // This is for platform independent things
 // TODO: move more stuff into this
@@ -121,7 +208,8 @@ struct Engine
 	static MemoryFunctions memfuncs;
 	static State state;
 
-	static bool32 init(void);
+	// memfuncs can't be changed later, default is malloc and free
+	static bool32 init(MemoryFunctions *memfuncs = nil);
 	static bool32 open(void);
 	static bool32 start(EngineStartParams*);
 	static void term(void);
@@ -137,7 +225,27 @@ struct Engine
 
 extern Engine *engine;
 
-// These must be macros because we might want to pass __FILE__ and __LINE__ later
+// These must be macros so we can pass __FILE__ and __LINE__
+#ifdef RW_MEMDEBUG
+// Tell the tracking functions where the allocation came from
+void *mallocDebug(size_t sz, uint32 hint, const char *file, int32 line);
+void *reallocDebug(void *p, size_t sz, uint32 hint, const char *file, int32 line);
+void *mustmallocDebug(size_t sz, uint32 hint, const char *file, int32 line);
+void *mustreallocDebug(void *p, size_t sz, uint32 hint, const char *file, int32 line);
+void *mallocAlignedDebug(size_t sz, uint32 align, uint32 hint, const char *file, int32 line);
+void *mustmallocAlignedDebug(size_t sz, uint32 align, uint32 hint, const char *file, int32 line);
+#define rwMalloc(s, h) rw::mallocDebug(s,h,__FILE__,__LINE__)
+#define rwMallocT(t, s, h) (t*)rw::mallocDebug((s)*sizeof(t),h,__FILE__,__LINE__)
+#define rwRealloc(p, s, h) rw::reallocDebug(p,s,h,__FILE__,__LINE__)
+#define rwReallocT(t, p, s, h) (t*)rw::reallocDebug(p,(s)*sizeof(t),h,__FILE__,__LINE__)
+#define rwFree(p) rw::Engine::memfuncs.rwfree(p)
+#define rwNew(s, h) rw::mustmallocDebug(s,h,__FILE__,__LINE__)
+#define rwNewT(t, s, h) (t*)rw::mustmallocDebug((s)*sizeof(t),h,__FILE__,__LINE__)
+#define rwResize(p, s, h) rw::mustreallocDebug(p,s,h,__FILE__,__LINE__)
+#define rwResizeT(t, p, s, h) (t*)rw::mustreallocDebug(p,(s)*sizeof(t),h,__FILE__,__LINE__)
+#define rwMallocAligned(s, a, h) rw::mallocAlignedDebug(s,a,h,__FILE__,__LINE__)
+#define rwNewAligned(s, a, h) rw::mustmallocAlignedDebug(s,a,h,__FILE__,__LINE__)
+#else
 #define rwMalloc(s, h) rw::Engine::memfuncs.rwmalloc(s,h)
 #define rwMallocT(t, s, h) (t*)rw::Engine::memfuncs.rwmalloc((s)*sizeof(t),h)
 #define rwRealloc(p, s, h) rw::Engine::memfuncs.rwrealloc(p,s,h)
@@ -147,6 +255,11 @@ extern Engine *engine;
 #define rwNewT(t, s, h) (t*)rw::Engine::memfuncs.rwmustmalloc((s)*sizeof(t),h)
 #define rwResize(p, s, h) rw::Engine::memfuncs.rwmustrealloc(p,s,h)
 #define rwResizeT(t, p, s, h) (t*)rw::Engine::memfuncs.rwmustrealloc(p,(s)*sizeof(t),h)
+#define rwMallocAligned(s, a, h) rw::Engine::memfuncs.rwmallocaligned(s,a,h)
+#define rwNewAligned(s, a, h) rw::mustmallocAligned(s,a,h)
+#endif
+#define rwFreeAligned(p) rw::Engine::memfuncs.rwfreealigned(p)
+void *mustmallocAligned(size_t sz, uint32 align, uint32 hint);
 
 namespace null {
 	void beginUpdate(Camera*);
@@ -0,0 +1,45 @@
+namespace rw {
+
+/*
+ * Asynchronous loading of clumps and texture dictionaries.
+ * Files are read into memory on an I/O thread. Finished requests
+ * are handed back through their callback on whichever thread
+ * calls poll().
+ *
+ * Parsing creates rasters, so it has to happen where the device
+ * can be used. With the null device requests are parsed on
+ * worker threads. Elsewhere (GL3, D3D) there are no workers and
+ * poll() parses them, so call it from the thread that owns the
+ * device. On PS2 everything happens inside poll().
+ *
+ * Requests are parsed with the StreamContext of the thread
+ * that made them. Since texture dictionaries aren't locked,
+ * clumps that look up textures are parsed one at a time and
+ * the current dictionary must not be changed meanwhile.
+ */
+
+struct AssetLoader
+{
+	// object is nil if loading failed
+	typedef void (*Callback)(int32 id, void *object, void *data);
+
+	// type is ID_CLUMP or ID_TEXDICTIONARY.
+	// Higher priority requests are served first.
+	// Returns an id for cancel() or -1.
+	int32 request(const char *path, int32 type, int32 priority,
+		Callback cb, void *data);
+	// True if the callback won't be called anymore.
+	// An object that was already loaded is destroyed.
+	bool32 cancel(int32 id);
+	// Call callbacks of finished requests, returns how many
+	int32 poll(void);
+	// Wait until all requests are finished, then poll()
+	void finish(void);
+	int32 numPending(void);
+
+	// numWorkers is only used with the null device
+	static AssetLoader *create(int32 numWorkers);
+	void destroy(void);
+};
+
+}
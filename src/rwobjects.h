@@ -26,6 +26,24 @@ struct Object
 	}
 };
 
+struct Frame;
+
+// A frame hierarchy flattened in depth first order with parent
+// indices, so syncing it is one loop instead of a tree walk.
+// Rebuilt on the next sync after frames were added or removed.
+struct FrameHierarchy
+{
+	int32 numFrames;
+	Frame **frames;		// root first
+	int32 *parents;		// -1 for the root
+	uint8 *dirty;
+	bool32 stale;
+
+	static FrameHierarchy *create(Frame *root);
+	void destroy(void);
+	void sync(bool32 ltm, bool32 objects);
+};
+
 struct Frame
 {
 	PLUGINBASE
@@ -54,6 +72,7 @@ struct Frame
 	Frame *child;
 	Frame *next;
 	Frame *root;
+	FrameHierarchy *hierarchy;	// only on roots
 
 	static Frame *create(void);
 	Frame *cloneHierarchy(void);
@@ -76,6 +95,10 @@ struct Frame
 
 
 	void syncHierarchyLTM(void);
+	// Sync this root's hierarchy through a FrameHierarchy,
+	// worth it for large ones like skeletons
+	bool32 compileHierarchy(void);
+	void uncompileHierarchy(void);
 	void setHierarchyRoot(Frame *root);
 	Frame *cloneAndLink(Frame *clonedroot);
 	void purgeClone(void);
@@ -86,6 +109,11 @@ struct Frame
 	static void syncDirty(void);
 };
 
+// Threads Frame::syncDirty spreads dirty hierarchies over.
+// 0 or 1 syncs everything serially. No speed-up has been
+// measured yet, on a single core it's only overhead.
+extern int32 frameSyncThreads;
+
 struct FrameList_
 {
 	int32 numFrames;
@@ -115,6 +143,14 @@ struct ObjectWithFrame
 		}
 	}
 	void sync(void){ this->syncCB(this); }
+	// Callbacks that only touch their own object may be called
+	// in parallel by Frame::syncDirty. They must not dirty frames.
+	// Callbacks that forward to another one (e.g. of an extension)
+	// pass a function that returns it, they're only thread safe
+	// if that one is too.
+	static void registerThreadSafeSync(Sync cb, Sync (*forwardsTo)(ObjectWithFrame*) = nil);
+	static bool32 isThreadSafeSync(Sync cb);
+	bool32 hasThreadSafeSync(void);
 	static ObjectWithFrame *fromFrame(LLLink *lnk){
 		return LLLinkGetData(lnk, ObjectWithFrame, inFrame);
 	}
@@ -354,6 +390,12 @@ struct Triangle
 	uint16 matId;
 };
 
+// Convert between streamed and in-memory triangles and mesh indices
+void unpackTriangles(Triangle *dst, uint32 *src, int32 numTris);
+void packTriangles(uint32 *dst, Triangle *src, int32 numTris);
+void unpackIndices(uint16 *dst, uint32 *src, int32 numIndices);
+void packIndices(uint32 *dst, uint16 *src, int32 numIndices);
+
 struct MaterialList
 {
 	Material **materials;
@@ -369,7 +411,8 @@ struct MaterialList
 	uint32 streamGetSize(void);
 };
 
-// TODO: implement locking
+// TODO: implement locking properly, for now
+//       it only makes borrowed data writable
 struct Geometry
 {
 	PLUGINBASE
@@ -392,9 +435,20 @@ struct Geometry
 	InstanceDataHeader *instData;
 
 	int32 refCount;
+	// size of the single allocation made by createPacked
+	uint32 packedSize;
 
 	static Geometry *create(int32 numVerts, int32 numTris, uint32 flags);
+	// Allocate geometry, plugins, attributes, morph targets
+	// and meshes in one block. Meshes are set up like
+	// allocateMeshes does, numMorphTargets is at least 1.
+	static Geometry *createPacked(int32 numVerts, int32 numTris, uint32 flags,
+		int32 numMorphTargets, int32 numMeshes = 0, uint32 numIndices = 0);
 	void destroy(void);
+	// For freeing and resizing attributes, morph targets
+	// and meshes that may be part of a packed geometry
+	void freeData(void *p);
+	void *resizeData(void *p, uint32 oldSize, uint32 newSize);
 	void addMorphTargets(int32 n);
 	void calculateBoundingSphere(void);
 	bool32 hasColoredMaterial(void);
@@ -405,7 +459,12 @@ struct Geometry
 	void buildTristrips(void);	// private, used by buildMeshes
 	void correctTristripWinding(void);
 	void removeUnusedMaterials(void);
+	void lock(int32 lockFlags);
 	static Geometry *streamRead(Stream *stream);
+	// Read the geometries of a geometry list, whose remaining
+	// length is given. Uses streamLoadThreads threads.
+	static bool32 streamReadList(Stream *stream, uint32 length,
+		Geometry **geometryList, int32 numGeometries);
 	bool streamWrite(Stream *stream);
 	uint32 streamGetSize(void);
 
@@ -431,6 +490,31 @@ struct Geometry
 		NATIVEINSTANCE = 0x02000000
 	};
 
+	enum LockFlags
+	{
+		LOCKPOLYGONS     = 0x0001,
+		LOCKVERTICES     = 0x0002,
+		LOCKNORMALS      = 0x0004,
+		LOCKPRELIGHT     = 0x0008,
+		LOCKTEXCOORDS    = 0x0010,
+		LOCKTEXCOORDS1   = 0x0010,
+		LOCKTEXCOORDS2   = 0x0020,
+		LOCKTEXCOORDS3   = 0x0040,
+		LOCKTEXCOORDS4   = 0x0080,
+		LOCKTEXCOORDS5   = 0x0100,
+		LOCKTEXCOORDS6   = 0x0200,
+		LOCKTEXCOORDS7   = 0x0400,
+		LOCKTEXCOORDS8   = 0x0800,
+		LOCKTEXCOORDSALL = 0x0ff0,
+		LOCKALL          = 0x0fff
+	};
+
+	enum {
+	// private flags
+		// Colors, tex coords, vertices and normals point into
+		// the buffer the geometry was read from (streamBorrowGeometry).
+		BORROWED = 0x01
+	};
 };
 
 void registerMeshPlugin(void);
@@ -496,6 +580,10 @@ struct Atomic
 	uint32 streamGetSize(void);
 
 	static void defaultRenderCB(Atomic *atomic);
+
+#ifndef RWPUBLIC
+	static void registerModule(void);
+#endif
 };
 
 void registerAtomicRightsPlugin(void);
@@ -547,6 +635,10 @@ struct Light
 		LIGHTATOMICS = 1,
 		LIGHTWORLD = 2
 	};
+
+#ifndef RWPUBLIC
+	static void registerModule(void);
+#endif
 };
 
 struct FrustumPlane
@@ -699,6 +791,10 @@ struct TexDictionary
 	void streamWrite(Stream *stream);
 	uint32 streamGetSize(void);
 
+	// The current dictionary is per thread. destroy() only
+	// clears it for the calling thread, so a dictionary must not
+	// be destroyed while another thread (or a StreamContext or
+	// AssetLoader request) still has it as the current one.
 	static void setCurrent(TexDictionary *txd);
 	static TexDictionary *getCurrent(void);
 };
@@ -11,11 +11,23 @@ typedef Stream *(*StreamWrite)(Stream *stream, int32 length, void *object, int32
 typedef int32 (*StreamGetSize)(void *object, int32 offset, int32 size);
 typedef void (*RightsCallback)(void *object, int32 offset, int32 size, uint32 data);
 
+// Flags for registerPlugin. The lower bits can hold the
+// alignment of the plugin data relative to the object.
+enum PluginFlags
+{
+	PLUGINALIGNMASK = 0xFFF,
+	// Put the data right after the object instead of after the
+	// data of plugins registered earlier if it fits into the space
+	// kept by reserveHot(). Otherwise it's placed like the rest.
+	PLUGINHOT = 0x1000
+};
+
 struct Plugin
 {
 	int32 offset;
 	int32 size;
 	uint32 id;
+	uint32 flags;
 	Constructor constructor;
 	Destructor destructor;
 	CopyConstructor copy;
@@ -33,6 +45,19 @@ struct PluginList
 	int32 defaultSize;
 	Plugin *first;
 	Plugin *last;
+	// Space after the object kept for PLUGINHOT data, the end
+	// of that data and the start of the rest (0 until known)
+	int32 hotReserve;
+	int32 hotEnd;
+	int32 coldStart;
+	// Hash table of plugins by ID and plugins that actually
+	// have constructors, destructors and copy constructors.
+	// Rebuilt on registration.
+	Plugin **table;
+	uint32 tableMask;
+	Plugin **ctors, **dtors, **copies;
+	int32 numCtors, numDtors, numCopies;
+	PluginList *nextList;	// lists with plugins, for freeAll()
 
 	void construct(void *);
 	void destruct(void *);
@@ -44,17 +69,25 @@ struct PluginList
 	void assertRights(void *, uint32 pluginID, uint32 data);
 
 	int32 registerPlugin(int32 size, uint32 id,
-		Constructor, Destructor, CopyConstructor);
+		Constructor, Destructor, CopyConstructor, uint32 flags = 0);
 	int32 registerStream(uint32 id, StreamRead, StreamWrite, StreamGetSize);
 	int32 setStreamRightsCallback(uint32 id, RightsCallback cb);
 	int32 getPluginOffset(uint32 id);
+	Plugin *find(uint32 id);
+	// Only works before the first plugin that isn't hot
+	void reserveHot(int32 size) { this->hotReserve += size; }
+	void dumpLayout(const char *name);
+	void update(void);	// private
+	// Free the plugins of all lists and make them empty again.
+	// Called by Engine::term.
+	static void freeAll(void);
 };
 
 #define PLUGINBASE \
 	static PluginList s_plglist;						    \
 	static int32 registerPlugin(int32 size, uint32 id, Constructor ctor, 	    \
-			Destructor dtor, CopyConstructor copy){			    \
-		return s_plglist.registerPlugin(size, id, ctor, dtor, copy);	    \
+			Destructor dtor, CopyConstructor copy, uint32 flags = 0){   \
+		return s_plglist.registerPlugin(size, id, ctor, dtor, copy, flags); \
 	}									    \
 	static int32 registerPluginStream(uint32 id, StreamRead read,		    \
 			StreamWrite write, StreamGetSize getSize){		    \
@@ -67,5 +100,7 @@ struct PluginList
 		return s_plglist.getPluginOffset(id);				    \
 	}
 
+// Print the plugin data layout of all object types on stdout
+void dumpPluginLayouts(void);
 
 }
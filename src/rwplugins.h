@@ -32,8 +32,7 @@ struct HAnimHierarchy
 {
 	int32 flags;
 	int32 numNodes;
-	Matrix *matrices;
-	void  *matricesUnaligned;
+	Matrix *matrices;	// 64 byte aligned
 	HAnimNodeInfo *nodeInfo;
 	Frame *parentFrame;
 	HAnimHierarchy *parentHierarchy;	// mostly unused
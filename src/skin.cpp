@@ -310,12 +310,14 @@ registerSkinPlugin(void)
 
 	int32 o;
 	o = Geometry::registerPlugin(sizeof(Skin*), ID_SKIN,
-	                             createSkin, destroySkin, copySkin);
+	                             createSkin, destroySkin, copySkin,
+	                             PLUGINHOT);
 	Geometry::registerPluginStream(ID_SKIN,
 	                               readSkin, writeSkin, getSizeSkin);
 	skinGlobals.geoOffset = o;
 	o = Atomic::registerPlugin(sizeof(HAnimHierarchy*),ID_SKIN,
-	                           createSkinAtm, destroySkinAtm, copySkinAtm);
+	                           createSkinAtm, destroySkinAtm, copySkinAtm,
+	                           PLUGINHOT);
 	skinGlobals.atomicOffset = o;
 	Atomic::setStreamRightsCallback(ID_SKIN, skinRights);
 }
@@ -28,7 +28,6 @@ PluginList Raster::s_plglist = { sizeof(Raster), sizeof(Raster), nil, nil };
 struct TextureGlobals
 {
 	TexDictionary *initialTexDict;
-	TexDictionary *currentTexDict;
 	// load textures from files
 	bool32 loadTextures;
 	// create dummy textures to store just names
@@ -36,6 +35,9 @@ struct TextureGlobals
 };
 int32 textureModuleOffset;
 
+// per thread so threads can load into different dictionaries
+static RWTHREADLOCAL TexDictionary *currentTexDict;
+
 #define TEXTUREGLOBAL(v) (PLUGINOFFSET(TextureGlobals, engine, textureModuleOffset)->v)
 
 static void*
@@ -96,8 +98,10 @@ TexDictionary::create(void)
 void
 TexDictionary::destroy(void)
 {
-	if(TEXTUREGLOBAL(currentTexDict) == this)
-		TEXTUREGLOBAL(currentTexDict) = nil;
+	// can only clear it for this thread, other threads
+	// must have stopped using it before
+	if(currentTexDict == this)
+		currentTexDict = nil;
 	FORLIST(lnk, this->textures)
 		Texture::fromDict(lnk)->destroy();
 	s_plglist.destruct(this);
@@ -133,6 +137,80 @@ TexDictionary::find(const char *name)
 	return nil;
 }
 
+struct TexReadJob
+{
+	uint8 *data;
+	uint32 length;
+	uint32 pos;
+	bool32 owned;
+	Texture *tex;
+};
+
+// Only the native data, plugins are read serially later
+static void
+texReadJob(void *data, int32 i)
+{
+	TexReadJob *job = &((TexReadJob*)data)[i];
+	StreamMemory view;
+	view.open(job->data, job->length);
+	job->tex = Texture::streamReadNative(&view);
+	job->pos = view.tell();
+}
+
+static bool32
+readTexturesParallel(Stream *stream, TexDictionary *txd, int32 numTex)
+{
+	int32 i;
+	uint32 len;
+	bool32 success = 0;
+	TexReadJob *jobs = rwNewT(TexReadJob, numTex, MEMDUR_FUNCTION | ID_TEXDICTIONARY);
+	for(i = 0; i < numTex; i++){
+		jobs[i].data = nil;
+		jobs[i].owned = 0;
+		jobs[i].tex = nil;
+	}
+
+	// Find all textures first, copy them unless we have them in memory
+	for(i = 0; i < numTex; i++){
+		if(!findChunk(stream, ID_TEXTURENATIVE, &len, nil)){
+			RWERROR((ERR_CHUNK, "TEXTURENATIVE"));
+			goto fail;
+		}
+		jobs[i].length = len;
+		jobs[i].data = stream->getData(len);
+		if(jobs[i].data == nil){
+			jobs[i].data = rwNewT(uint8, len, MEMDUR_FUNCTION | ID_TEXDICTIONARY);
+			jobs[i].owned = 1;
+			stream->read(jobs[i].data, len);
+		}
+	}
+
+	runJobs(streamTextureThreads, numTex, texReadJob, jobs);
+
+	// Add in original order
+	for(i = 0; i < numTex; i++){
+		if(jobs[i].tex == nil)
+			goto fail;
+		StreamMemory view;
+		view.open(jobs[i].data, jobs[i].length);
+		view.seek(jobs[i].pos, 0);
+		Texture::s_plglist.streamRead(&view, jobs[i].tex);
+		txd->add(jobs[i].tex);
+		jobs[i].tex = nil;
+	}
+	success = 1;
+
+fail:
+	for(i = 0; i < numTex; i++){
+		if(jobs[i].tex)
+			jobs[i].tex->destroy();
+		if(jobs[i].owned)
+			rwFree(jobs[i].data);
+	}
+	rwFree(jobs);
+	return success;
+}
+
 TexDictionary*
 TexDictionary::streamRead(Stream *stream)
 {
@@ -148,7 +226,10 @@ TexDictionary::streamRead(Stream *stream)
 	if(txd == nil)
 		return nil;
 	Texture *tex;
-	for(int32 i = 0; i < numTex; i++){
+	if(streamTextureThreads > 1 && numTex > 1){
+		if(!readTexturesParallel(stream, txd, numTex))
+			goto fail;
+	}else for(int32 i = 0; i < numTex; i++){
 		if(!findChunk(stream, ID_TEXTURENATIVE, nil, nil)){
 			RWERROR((ERR_CHUNK, "TEXTURENATIVE"));
 			goto fail;
@@ -169,20 +250,26 @@ fail:
 void
 TexDictionary::streamWrite(Stream *stream)
 {
-	writeChunkHeader(stream, ID_TEXDICTIONARY, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_TEXDICTIONARY, size);
 	writeChunkHeader(stream, ID_STRUCT, 4);
 	int32 numTex = this->count();
 	stream->writeI16(numTex);
 	stream->writeI16(0);
 	FORLIST(lnk, this->textures){
 		Texture *tex = Texture::fromDict(lnk);
-		uint32 sz = tex->streamGetSizeNative();
-		sz += 12 + Texture::s_plglist.streamGetSize(tex);
-		writeChunkHeader(stream, ID_TEXTURENATIVE, sz);
+		int32 sz = 0;
+		if(needChunkSize()){
+			sz = tex->streamGetSizeNative();
+			sz += 12 + Texture::s_plglist.streamGetSize(tex);
+		}
+		uint32 texstart = beginChunk(stream, ID_TEXTURENATIVE, sz);
 		tex->streamWriteNative(stream);
 		Texture::s_plglist.streamWrite(stream, tex);
+		endChunk(stream, texstart, sz);
 	}
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 }
 
 uint32
@@ -201,13 +288,13 @@ TexDictionary::streamGetSize(void)
 void
 TexDictionary::setCurrent(TexDictionary *txd)
 {
-	PLUGINOFFSET(TextureGlobals, engine, textureModuleOffset)->currentTexDict = txd;
+	currentTexDict = txd;
 }
 
 TexDictionary*
 TexDictionary::getCurrent(void)
 {
-	return PLUGINOFFSET(TextureGlobals, engine, textureModuleOffset)->currentTexDict;
+	return currentTexDict;
 }
 
 //
@@ -223,7 +310,7 @@ Texture *(*Texture::readCB)(const char *name, const char *mask) = defaultReadCB;
 Texture*
 Texture::create(Raster *raster)
 {
-	Texture *tex = (Texture*)rwMalloc(s_plglist.size, MEMDUR_EVENT | ID_TEXTURE);
+	Texture *tex = (Texture*)objPoolAlloc(OBJPOOL_TEXTURE, s_plglist.size, MEMDUR_EVENT | ID_TEXTURE);
 	if(tex == nil){
 		RWERROR((ERR_ALLOC, s_plglist.size));
 		return nil;
@@ -249,15 +336,15 @@ Texture::destroy(void)
 			this->inDict.remove();
 		if(this->raster)
 			this->raster->destroy();
-		rwFree(this);
+		objPoolFree(OBJPOOL_TEXTURE, this);
 	}
 }
 
 static Texture*
 defaultFindCB(const char *name)
 {
-	if(TEXTUREGLOBAL(currentTexDict))
-		return TEXTUREGLOBAL(currentTexDict)->find(name);
+	if(currentTexDict)
+		return currentTexDict->find(name);
 	// TODO: RW searches *all* TXDs otherwise
 	return nil;
 }
@@ -311,10 +398,10 @@ Texture::read(const char *name, const char *mask)
 		raster = Raster::create(0, 0, 0, Raster::DONTALLOCATE);
 		tex->raster = raster;
 	}
-	if(tex && TEXTUREGLOBAL(currentTexDict)){
+	if(tex && currentTexDict){
 		if(tex->dict)
 			tex->inDict.remove();
-		TEXTUREGLOBAL(currentTexDict)->add(tex);
+		currentTexDict->add(tex);
 	}
 	return tex;
 }
@@ -363,25 +450,27 @@ Texture::streamRead(Stream *stream)
 bool
 Texture::streamWrite(Stream *stream)
 {
-	int size;
+	int len;
 	char buf[36];
-	writeChunkHeader(stream, ID_TEXTURE, this->streamGetSize());
+	int32 size = needChunkSize() ? this->streamGetSize() : 0;
+	uint32 start = beginChunk(stream, ID_TEXTURE, size);
 	writeChunkHeader(stream, ID_STRUCT, 4);
 	stream->writeU32(this->filterAddressing);
 
 	memset(buf, 0, 36);
 	strncpy(buf, this->name, 32);
-	size = strlen(buf)+4 & ~3;
-	writeChunkHeader(stream, ID_STRING, size);
-	stream->write(buf, size);
+	len = strlen(buf)+4 & ~3;
+	writeChunkHeader(stream, ID_STRING, len);
+	stream->write(buf, len);
 
 	memset(buf, 0, 36);
 	strncpy(buf, this->mask, 32);
-	size = strlen(buf)+4 & ~3;
-	writeChunkHeader(stream, ID_STRING, size);
-	stream->write(buf, size);
+	len = strlen(buf)+4 & ~3;
+	writeChunkHeader(stream, ID_STRING, len);
+	stream->write(buf, len);
 
 	s_plglist.streamWrite(stream, this);
+	endChunk(stream, start, size);
 	return true;
 }
 
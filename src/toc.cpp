@@ -0,0 +1,278 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include "rwbase.h"
+#include "rwerror.h"
+#include "rwplg.h"
+#include "rwpipeline.h"
+#include "rwobjects.h"
+#include "rwengine.h"
+
+#define PLUGIN_ID ID_CHUNKINDEX
+
+namespace rw {
+
+ChunkIndex*
+ChunkIndex::create(void)
+{
+	ChunkIndex *idx = (ChunkIndex*)rwMalloc(sizeof(ChunkIndex), MEMDUR_EVENT | ID_CHUNKINDEX);
+	if(idx == nil){
+		RWERROR((ERR_ALLOC, sizeof(ChunkIndex)));
+		return nil;
+	}
+	idx->entries = nil;
+	idx->numEntries = 0;
+	idx->space = 0;
+	idx->base = 0;
+	return idx;
+}
+
+void
+ChunkIndex::destroy(void)
+{
+	rwFree(this->entries);
+	rwFree(this);
+}
+
+int32
+ChunkIndex::addEntry(ChunkHeaderInfo *header, uint32 offset, int32 parent)
+{
+	if(this->numEntries >= this->space){
+		int32 space = this->space ? 2*this->space : 64;
+		Entry *entries = rwReallocT(Entry, this->entries, space,
+			MEMDUR_EVENT | ID_CHUNKINDEX);
+		if(entries == nil){
+			RWERROR((ERR_ALLOC, space*sizeof(Entry)));
+			return -1;
+		}
+		this->entries = entries;
+		this->space = space;
+	}
+	Entry *e = &this->entries[this->numEntries];
+	e->type = header->type;
+	e->length = header->length;
+	e->version = header->version;
+	e->build = header->build;
+	e->offset = offset;
+	e->parent = parent;
+	memset(e->name, 0, 32);
+	return this->numEntries++;
+}
+
+// Structs and strings are never made up of chunks
+static bool32
+isLeafChunk(uint32 type)
+{
+	return type == ID_STRUCT || type == ID_STRING;
+}
+
+// Texture names are either in a STRING (generic textures and PS2)
+// or at the start of the STRUCT (D3D and Xbox native textures).
+static void
+readTextureName(ChunkIndex *idx, Stream *stream, int32 i)
+{
+	ChunkIndex::Entry *e = &idx->entries[i];
+	int32 s = idx->findChild(i, ID_STRUCT);
+	if(e->type == ID_TEXTURENATIVE && s >= 0 &&
+	   idx->entries[s].length >= 8+32){
+		stream->seek(idx->base + idx->entries[s].offset, 0);
+		if(stream->readU32() != FOURCC_PS2){
+			stream->seek(4);
+			stream->read(e->name, 32);
+			return;
+		}
+	}
+	s = idx->findChild(i, ID_STRING);
+	if(s >= 0){
+		uint32 len = idx->entries[s].length;
+		stream->seek(idx->base + idx->entries[s].offset, 0);
+		stream->read(e->name, len < 32 ? len : 32);
+	}
+}
+
+// Index the chunks inside [start, end). We can't know whether
+// a chunk contains other chunks, so we try and back out
+// if the data doesn't look like chunks of the same version.
+static bool32
+indexChildren(ChunkIndex *idx, Stream *stream, uint32 start, uint32 end,
+              int32 parent, uint32 version, uint32 build)
+{
+	ChunkHeaderInfo header;
+	int32 first = idx->numEntries;
+	uint32 pos = start;
+	while(pos < end){
+		if(end - pos < 12)
+			goto notchunks;
+		stream->seek(pos, 0);
+		if(!readChunkHeaderInfo(stream, &header) ||
+		   header.version != version || header.build != build ||
+		   header.length > end - pos - 12)
+			goto notchunks;
+		int32 i = idx->addEntry(&header, pos+12 - idx->base, parent);
+		if(i < 0)
+			return 0;
+		if(!isLeafChunk(header.type))
+			indexChildren(idx, stream, pos+12, pos+12+header.length,
+			              i, version, build);
+		if(header.type == ID_TEXTURENATIVE || header.type == ID_TEXTURE)
+			readTextureName(idx, stream, i);
+		pos += 12 + header.length;
+	}
+	return 1;
+notchunks:
+	idx->numEntries = first;
+	return 0;
+}
+
+// Index all chunks from the current position to the end of the stream
+bool32
+ChunkIndex::build(Stream *stream)
+{
+	ChunkHeaderInfo header;
+	uint32 pos;
+	this->numEntries = 0;
+	this->base = stream->tell();
+	while(pos = stream->tell(), readChunkHeaderInfo(stream, &header)){
+		if(header.type == ID_NAOBJECT)
+			break;
+		int32 i = this->addEntry(&header, pos+12 - this->base, -1);
+		if(i < 0)
+			return 0;
+		if(!isLeafChunk(header.type))
+			indexChildren(this, stream, pos+12, pos+12+header.length,
+			              i, header.version, header.build);
+		if(header.type == ID_TEXTURENATIVE || header.type == ID_TEXTURE)
+			readTextureName(this, stream, i);
+		stream->seek(pos+12+header.length, 0);
+	}
+	return this->numEntries > 0;
+}
+
+// n-th chunk of a type anywhere in the stream
+int32
+ChunkIndex::find(uint32 type, int32 n)
+{
+	for(int32 i = 0; i < this->numEntries; i++)
+		if(this->entries[i].type == type && n-- == 0)
+			return i;
+	return -1;
+}
+
+// n-th chunk of a type directly inside another one
+int32
+ChunkIndex::findChild(int32 parent, uint32 type, int32 n)
+{
+	// children follow their parent and end with it
+	uint32 end = this->entries[parent].offset + this->entries[parent].length;
+	for(int32 i = parent+1; i < this->numEntries; i++){
+		if(this->entries[i].offset >= end)
+			break;
+		if(this->entries[i].parent == parent &&
+		   this->entries[i].type == type && n-- == 0)
+			return i;
+	}
+	return -1;
+}
+
+int32
+ChunkIndex::findTexture(const char *name)
+{
+	for(int32 i = 0; i < this->numEntries; i++)
+		if((this->entries[i].type == ID_TEXTURENATIVE ||
+		    this->entries[i].type == ID_TEXTURE) &&
+		   strncmp_ci(this->entries[i].name, name, 32) == 0)
+			return i;
+	return -1;
+}
+
+// Position the stream right after the header of a chunk,
+// which is where its streamRead function expects it.
+bool32
+ChunkIndex::seek(Stream *stream, int32 i)
+{
+	if(i < 0 || i >= this->numEntries)
+		return 0;
+	stream->seek(this->base + this->entries[i].offset, 0);
+	return 1;
+}
+
+struct TocStreamEntry
+{
+	uint32 type;
+	uint32 length;
+	uint32 libid;
+	uint32 offset;
+	int32 parent;
+	char name[32];
+};
+
+ChunkIndex*
+ChunkIndex::streamRead(Stream *stream)
+{
+	TocStreamEntry buf;
+	ChunkHeaderInfo header;
+	uint32 length;
+	int32 n;
+	if(!findChunk(stream, ID_STRUCT, &length, nil)){
+		RWERROR((ERR_CHUNK, "STRUCT"));
+		return nil;
+	}
+	if(length < 4 || stream->read(&n, 4) != 4 ||
+	   n < 0 || (uint32)n > (length-4)/sizeof(TocStreamEntry)){
+		RWERROR((ERR_GENERAL, "bad chunk index"));
+		return nil;
+	}
+	ChunkIndex *idx = ChunkIndex::create();
+	if(idx == nil)
+		return nil;
+	for(int32 i = 0; i < n; i++){
+		if(stream->read(&buf, sizeof(TocStreamEntry)) != sizeof(TocStreamEntry) ||
+		   buf.parent < -1 || buf.parent >= i){
+			RWERROR((ERR_GENERAL, "bad chunk index"));
+			goto fail;
+		}
+		header.type = buf.type;
+		header.length = buf.length;
+		header.version = libraryIDUnpackVersion(buf.libid);
+		header.build = libraryIDUnpackBuild(buf.libid);
+		if(idx->addEntry(&header, buf.offset, buf.parent) < 0)
+			goto fail;
+		memcpy(idx->entries[i].name, buf.name, 32);
+	}
+	idx->base = stream->tell();
+	return idx;
+
+fail:
+	idx->destroy();
+	return nil;
+}
+
+bool
+ChunkIndex::streamWrite(Stream *stream)
+{
+	TocStreamEntry buf;
+	writeChunkHeader(stream, ID_CHUNKINDEX, this->streamGetSize());
+	writeChunkHeader(stream, ID_STRUCT, 4 + this->numEntries*sizeof(TocStreamEntry));
+	stream->writeI32(this->numEntries);
+	for(int32 i = 0; i < this->numEntries; i++){
+		Entry *e = &this->entries[i];
+		buf.type = e->type;
+		buf.length = e->length;
+		buf.libid = libraryIDPack(e->version, e->build);
+		buf.offset = e->offset;
+		buf.parent = e->parent;
+		memcpy(buf.name, e->name, 32);
+		stream->write(&buf, sizeof(TocStreamEntry));
+	}
+	return true;
+}
+
+uint32
+ChunkIndex::streamGetSize(void)
+{
+	return 12 + 4 + this->numEntries*sizeof(TocStreamEntry);
+}
+
+}
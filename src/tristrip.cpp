@@ -612,7 +612,7 @@ printSmesh(&smesh);
 		memcpy(md[i].indices, ms[i].indices, md[i].numIndices*sizeof(uint16));
 		rwFree(ms[i].indices);
 	}
-	rwFree(header);
+	this->freeData(header);
 
 	verifyMesh(this);
 }
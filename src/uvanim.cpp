@@ -28,7 +28,7 @@ UVAnimCustomData::destroy(Animation *anim)
 		anim->destroy();
 }
 
-UVAnimDictionary *currentUVAnimDictionary;
+RWTHREADLOCAL UVAnimDictionary *currentUVAnimDictionary;
 
 UVAnimDictionary*
 UVAnimDictionary::create(void)
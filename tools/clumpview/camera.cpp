@@ -26,7 +26,7 @@ Camera::update(void)
 			f->matrix.up = nup;
 			f->matrix.at = forward;
 			f->matrix.pos = m_position;
-			f->matrix.optimize();
+			f->matrix.optimizeOrthonormal();
 			f->updateObjects();
 		}
 	}
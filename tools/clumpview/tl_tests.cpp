@@ -519,9 +519,10 @@ drawMesh(MeshState *mstate, ObjSpace3DVertex *objverts, uint16 *indices)
 	uint16 *cullindices, *clipindices;
 	uint32 numClip;
 
-	camverts = rwNewT(CamSpace3DVertex, mstate->numVertices, MEMDUR_FUNCTION);
-	scrverts = rwNewT(Im2DVertex, mstate->numVertices, MEMDUR_FUNCTION);
-	cullindices = rwNewT(uint16, mstate->numPrimitives*3, MEMDUR_FUNCTION);
+	FrameAllocator *fa = FrameAllocator::get();
+	camverts = rwFrameNewT(CamSpace3DVertex, mstate->numVertices);
+	scrverts = rwFrameNewT(Im2DVertex, mstate->numVertices);
+	cullindices = rwFrameNewT(uint16, mstate->numPrimitives*3);
 
 	transform(mstate, objverts, camverts, scrverts);
 
@@ -547,18 +548,17 @@ drawMesh(MeshState *mstate, ObjSpace3DVertex *objverts, uint16 *indices)
 
 	// each triangle can have a maximum of 9 vertices (7 triangles) after clipping
 	// so resize to whatever we may need
-	camverts = rwResizeT(CamSpace3DVertex, camverts, mstate->numVertices + numClip*9, MEMDUR_FUNCTION);
-	scrverts = rwResizeT(Im2DVertex, scrverts, mstate->numVertices + numClip*9, MEMDUR_FUNCTION);
-	clipindices = rwNewT(uint16, mstate->numPrimitives*3 + numClip*7*3, MEMDUR_FUNCTION);
+	camverts = (CamSpace3DVertex*)fa->resize(camverts,
+		mstate->numVertices*sizeof(CamSpace3DVertex),
+		(mstate->numVertices + numClip*9)*sizeof(CamSpace3DVertex));
+	scrverts = (Im2DVertex*)fa->resize(scrverts,
+		mstate->numVertices*sizeof(Im2DVertex),
+		(mstate->numVertices + numClip*9)*sizeof(Im2DVertex));
+	clipindices = rwFrameNewT(uint16, mstate->numPrimitives*3 + numClip*7*3);
 
 	clipTriangles(mstate, camverts, scrverts, cullindices, clipindices);
 
 	submitTriangles(scrverts, mstate->numVertices, clipindices, mstate->numPrimitives);
-
-	rwFree(camverts);
-	rwFree(scrverts);
-	rwFree(cullindices);
-	rwFree(clipindices);
 }
 
 static void
@@ -627,7 +627,7 @@ genIm3DTransform(void *vertices, int32 numVertices, Matrix *world)
 	if(world)
 		xform.transform(world, COMBINEPRECONCAT);
 
-	clipverts = rwNewT(Im2DVertex, numVertices, MEMDUR_EVENT);
+	clipverts = rwFrameNewT(Im2DVertex, numVertices);
 	numClipverts = numVertices;
 
 	for(i = 0; i < numVertices; i++){
@@ -656,7 +656,6 @@ genIm3DRenderIndexed(PrimitiveType prim, void *indices, int32 numIndices)
 void
 genIm3DEnd(void)
 {
-	rwFree(clipverts);
 	clipverts = nil;
 	numClipverts = 0;
 }
@@ -80,6 +80,8 @@ getChunkName(uint32 id)
 		return "Vertex Format PLG";
 	case 0xF21E:
 		return "ZModeler Lock";
+	case ID_CHUNKINDEX:
+		return "librw Chunk Index";
 	}
 
 	if(id <= 45)
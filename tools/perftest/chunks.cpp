@@ -0,0 +1,190 @@
+#include "perftest.h"
+
+// ChunkIndex against scanning with findChunk. An index that was
+// written out and read back has to find the same chunks, also when
+// the indexed data sits at a different offset than when it was built.
+
+#define NUMGEOS 200
+#define PREFIX 100
+#define BUFSIZE (4<<20)
+#define REPS 20
+
+static uint8 *dataBuf, *fileBuf;
+static uint32 dataLength, fileLength;
+
+static Geometry*
+makeGeometry(int32 n)
+{
+	int32 i;
+	Geometry *geo = Geometry::create(n+2, n, Geometry::POSITIONS);
+	if(geo == nil)
+		return nil;
+	V3d *v = geo->morphTargets[0].vertices;
+	for(i = 0; i < n+2; i++)
+		v[i].set(randFloat(), randFloat(), randFloat());
+	for(i = 0; i < n; i++){
+		geo->triangles[i].v[0] = i;
+		geo->triangles[i].v[1] = i+1;
+		geo->triangles[i].v[2] = i+2;
+		geo->triangles[i].matId = 0;
+	}
+	geo->calculateBoundingSphere();
+	return geo;
+}
+
+static int32
+numVerts(int32 k)
+{
+	return 10 + k*7;
+}
+
+// Some junk, then the geometries. Returns the stream length.
+static uint32
+writeGeometries(uint8 *buf)
+{
+	StreamMemory stream;
+	uint8 junk[PREFIX];
+	memset(junk, 0xAA, PREFIX);
+	stream.open(buf, 0, BUFSIZE);
+	stream.write(junk, PREFIX);
+	for(int32 k = 0; k < NUMGEOS; k++){
+		Geometry *geo = makeGeometry(numVerts(k));
+		geo->streamWrite(&stream);
+		geo->destroy();
+	}
+	return stream.getLength();
+}
+
+static bool32
+sameGeometry(Geometry *geo, int32 k, Geometry *ref)
+{
+	return geo && geo->numVertices == numVerts(k)+2 &&
+		geo->numTriangles == ref->numTriangles &&
+		memcmp(geo->morphTargets[0].vertices, ref->morphTargets[0].vertices,
+			geo->numVertices*sizeof(V3d)) == 0 &&
+		memcmp(geo->triangles, ref->triangles,
+			geo->numTriangles*sizeof(Triangle)) == 0;
+}
+
+// Geometries behind some junk are indexed, then the index is
+// written out followed by the geometries alone
+static ChunkIndex*
+makeFile(void)
+{
+	StreamMemory stream;
+	ChunkIndex *idx;
+
+	dataBuf = rwNewT(uint8, BUFSIZE, MEMDUR_EVENT);
+	fileBuf = rwNewT(uint8, BUFSIZE, MEMDUR_EVENT);
+	dataLength = writeGeometries(dataBuf);
+	stream.open(dataBuf, dataLength);
+	stream.seek(PREFIX, 0);
+	idx = ChunkIndex::create();
+	if(!idx->build(&stream) || idx->base != PREFIX){
+		idx->destroy();
+		return nil;
+	}
+	stream.open(fileBuf, 0, BUFSIZE);
+	idx->streamWrite(&stream);
+	stream.write(dataBuf+PREFIX, dataLength-PREFIX);
+	fileLength = stream.getLength();
+	return idx;
+}
+
+static void
+freeFile(void)
+{
+	rwFree(dataBuf);
+	rwFree(fileBuf);
+}
+
+static int32
+testChunks(void)
+{
+	StreamMemory stream;
+	ChunkIndex *idx, *saved;
+	Geometry *geo, *ref;
+	int32 k, i, failed, seed;
+
+	failed = 0;
+	seed = rand();
+	srand(seed);
+	if((idx = makeFile()) == nil){
+		printf("  build failed\n");
+		freeFile();
+		return 1;
+	}
+	stream.open(fileBuf, fileLength);
+	if(!findChunk(&stream, ID_CHUNKINDEX, nil, nil) ||
+	   (saved = ChunkIndex::streamRead(&stream)) == nil){
+		printf("  can't read index back\n");
+		idx->destroy();
+		freeFile();
+		return 1;
+	}
+	if(saved->numEntries != idx->numEntries ||
+	   memcmp(saved->entries, idx->entries, idx->numEntries*sizeof(ChunkIndex::Entry)) != 0){
+		printf("  index differs after reading it back\n");
+		failed++;
+	}
+
+	// same random geometries again to compare with
+	srand(seed);
+	for(k = 0; k < NUMGEOS && !failed; k++){
+		ref = makeGeometry(numVerts(k));
+		i = saved->find(ID_GEOMETRY, k);
+		geo = saved->seek(&stream, i) ? Geometry::streamRead(&stream) : nil;
+		if(!sameGeometry(geo, k, ref)){
+			printf("  geometry %d differs\n", k);
+			failed++;
+		}
+		if(geo)
+			geo->destroy();
+		ref->destroy();
+	}
+	idx->destroy();
+	saved->destroy();
+	freeFile();
+	return failed;
+}
+
+static ChunkIndex *benchIndex;
+static StreamMemory benchStream;
+
+// Find every geometry from the start, as without an index
+static void
+benchScan(void)
+{
+	uint32 length;
+	for(int32 k = 0; k < NUMGEOS; k++){
+		benchStream.seek(benchIndex->base, 0);
+		for(int32 j = 0; j <= k; j++){
+			findChunk(&benchStream, ID_GEOMETRY, &length, nil);
+			if(j < k)
+				benchStream.seek(length);
+		}
+	}
+}
+
+static void
+benchFind(void)
+{
+	for(int32 k = 0; k < NUMGEOS; k++)
+		benchIndex->seek(&benchStream, benchIndex->find(ID_GEOMETRY, k));
+}
+
+static void
+benchChunks(void)
+{
+	makeFile()->destroy();
+	benchStream.open(fileBuf, fileLength);
+	findChunk(&benchStream, ID_CHUNKINDEX, nil, nil);
+	benchIndex = ChunkIndex::streamRead(&benchStream);
+	printf("  %d geometries, %d chunks\n", NUMGEOS, benchIndex->numEntries);
+	printRate("ChunkIndex::find + seek", NUMGEOS/bestTime(benchFind, REPS), "lookups",
+		NUMGEOS/bestTime(benchScan, REPS));
+	benchIndex->destroy();
+	freeFile();
+}
+
+Suite chunkSuite = { "chunks", 1, testChunks, benchChunks };
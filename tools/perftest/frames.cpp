@@ -0,0 +1,221 @@
+#include "perftest.h"
+
+// Frame::syncDirty on characters with NUMBONES bones and on a scene
+// of many small hierarchies, each with an atomic. Compiled hierarchies
+// and parallel syncing have to give the same LTMs as plain recursion.
+
+#define NUMBONES 128
+#define NUMCHARS 100
+#define NUMPROPS 4000
+#define PROPFRAMES 3
+#define SYNCTHREADS 4
+#define REPS 30
+
+struct Hierarchies
+{
+	int32 numRoots;
+	int32 numFrames;	// per root
+	Frame **frames;		// numFrames for every root, root first
+	Atomic **atomics;	// one per root
+};
+
+static V3d axis = { 0.3f, 0.5f, 0.81f };
+static int32 step;
+
+// A spine first, limbs branch off from random earlier bones
+static void
+makeHierarchy(Frame **frames, int32 n)
+{
+	V3d t;
+	frames[0] = Frame::create();
+	for(int32 i = 1; i < n; i++){
+		frames[i] = Frame::create();
+		t.set(0.1f*(i%7), 0.2f, 0.05f*(i%3));
+		frames[i]->translate(&t, COMBINEREPLACE);
+		frames[i < 8 ? i-1 : rand()%i]->addChild(frames[i], 1);
+	}
+}
+
+static void
+createHierarchies(Hierarchies *h, int32 numRoots, int32 numFrames, bool32 compiled)
+{
+	h->numRoots = numRoots;
+	h->numFrames = numFrames;
+	h->frames = rwNewT(Frame*, numRoots*numFrames, MEMDUR_EVENT);
+	h->atomics = rwNewT(Atomic*, numRoots, MEMDUR_EVENT);
+	for(int32 i = 0; i < numRoots; i++){
+		Frame **frames = &h->frames[i*numFrames];
+		makeHierarchy(frames, numFrames);
+		if(compiled)
+			frames[0]->compileHierarchy();
+		h->atomics[i] = Atomic::create();
+		h->atomics[i]->setFrame(frames[numFrames-1]);
+	}
+	Frame::syncDirty();
+}
+
+static void
+destroyHierarchies(Hierarchies *h)
+{
+	for(int32 i = 0; i < h->numRoots; i++){
+		h->atomics[i]->destroy();
+		h->frames[i*h->numFrames]->destroyHierarchy();
+	}
+	rwFree(h->frames);
+	rwFree(h->atomics);
+}
+
+// Every bone of a character moves, only some of the props do
+static void
+animate(Hierarchies *h, int32 every)
+{
+	int32 i, j;
+	for(i = step % every; i < h->numRoots; i += every){
+		Frame **frames = &h->frames[i*h->numFrames];
+		for(j = 0; j < h->numFrames; j++)
+			frames[j]->rotate(&axis, (float32)((step*31 + i + j) % 17), COMBINEPRECONCAT);
+	}
+	step++;
+}
+
+static bool32
+sameLTM(Frame *a, Frame *b)
+{
+	Matrix *x = a->getLTM();
+	Matrix *y = b->getLTM();
+	return memcmp(&x->right, &y->right, sizeof(V3d)) == 0 &&
+		memcmp(&x->up, &y->up, sizeof(V3d)) == 0 &&
+		memcmp(&x->at, &y->at, sizeof(V3d)) == 0 &&
+		memcmp(&x->pos, &y->pos, sizeof(V3d)) == 0 &&
+		x->flags == y->flags;
+}
+
+static int32
+compareHierarchies(Hierarchies *a, Hierarchies *b, const char *what)
+{
+	int32 i;
+	for(i = 0; i < a->numRoots*a->numFrames; i++)
+		if(!sameLTM(a->frames[i], b->frames[i])){
+			printf("  %s: LTM of frame %d differs\n", what, i);
+			return 1;
+		}
+	for(i = 0; i < a->numRoots; i++)
+		if(!(a->atomics[i]->object.object.privateFlags & Atomic::WORLDBOUNDDIRTY) ||
+		   !(b->atomics[i]->object.object.privateFlags & Atomic::WORLDBOUNDDIRTY)){
+			printf("  %s: atomic %d wasn't synched\n", what, i);
+			return 1;
+		}
+	return 0;
+}
+
+static void
+clearAtomics(Hierarchies *h)
+{
+	for(int32 i = 0; i < h->numRoots; i++)
+		h->atomics[i]->object.object.privateFlags &= ~Atomic::WORLDBOUNDDIRTY;
+}
+
+static int32
+testFrames(void)
+{
+	Hierarchies rec, comp;
+	int32 i, saved, failed;
+
+	// same random tree for both
+	failed = 0;
+	saved = rand();
+	srand(saved);
+	createHierarchies(&rec, NUMCHARS/4, NUMBONES, 0);
+	srand(saved);
+	createHierarchies(&comp, NUMCHARS/4, NUMBONES, 1);
+	for(i = 0; i < 8 && !failed; i++){
+		// both dirty at once, so they're synched in the same call
+		saved = step;
+		animate(&rec, 1);
+		step = saved;
+		animate(&comp, 1);
+		clearAtomics(&rec);
+		clearAtomics(&comp);
+		frameSyncThreads = i&1 ? SYNCTHREADS : 0;
+		Frame::syncDirty();
+		failed += compareHierarchies(&rec, &comp, i&1 ? "parallel" : "serial");
+	}
+	// changing the structure makes compiled hierarchies stale
+	for(i = 0; i < rec.numRoots && !failed; i++){
+		Frame **f = &rec.frames[i*NUMBONES];
+		Frame **g = &comp.frames[i*NUMBONES];
+		f[20]->removeChild();
+		f[0]->addChild(f[20]);
+		g[20]->removeChild();
+		g[0]->addChild(g[20]);
+		f[30]->rotate(&axis, 3.0f, COMBINEPRECONCAT);
+		g[30]->rotate(&axis, 3.0f, COMBINEPRECONCAT);
+	}
+	if(!failed){
+		Frame::syncDirty();
+		failed += compareHierarchies(&rec, &comp, "restructured");
+	}
+	frameSyncThreads = 0;
+	destroyHierarchies(&rec);
+	destroyHierarchies(&comp);
+	return failed;
+}
+
+static void
+printRate2(const char *name, const char *suffix, double perSec, const char *unit, double refPerSec)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%s%s", name, suffix);
+	printRate(buf, perSec, unit, refPerSec);
+}
+
+static Hierarchies *benchSet;
+static int32 benchEvery;
+static void benchAnimate(void) { animate(benchSet, benchEvery); }
+static void benchSync(void) { Frame::syncDirty(); }
+
+// Frames per second updated by syncDirty
+static double
+syncRate(Hierarchies *h, int32 every, int32 threads)
+{
+	benchSet = h;
+	benchEvery = every;
+	frameSyncThreads = threads;
+	double t = bestTime(benchSync, REPS, benchAnimate);
+	frameSyncThreads = 0;
+	return (h->numRoots + every-1)/every * h->numFrames / t;
+}
+
+static void
+benchFrames(void)
+{
+	Hierarchies h;
+	double rec, comp;
+	char threads[32];
+
+	snprintf(threads, sizeof(threads), ", %d threads", SYNCTHREADS);
+
+	printf("  %d characters with %d bones\n", NUMCHARS, NUMBONES);
+	createHierarchies(&h, NUMCHARS, NUMBONES, 0);
+	rec = syncRate(&h, 1, 0);
+	printRate("recursive", rec, "frames", 0.0);
+	printRate2("recursive", threads, syncRate(&h, 1, SYNCTHREADS), "frames", rec);
+	destroyHierarchies(&h);
+	createHierarchies(&h, NUMCHARS, NUMBONES, 1);
+	comp = syncRate(&h, 1, 0);
+	printRate("compiled", comp, "frames", rec);
+	printRate2("compiled", threads, syncRate(&h, 1, SYNCTHREADS), "frames", comp);
+	destroyHierarchies(&h);
+
+	printf("  %d props with %d frames, a quarter moving\n", NUMPROPS, PROPFRAMES);
+	createHierarchies(&h, NUMPROPS, PROPFRAMES, 0);
+	rec = syncRate(&h, 4, 0);
+	printRate("recursive", rec, "frames", 0.0);
+	printRate2("recursive", threads, syncRate(&h, 4, SYNCTHREADS), "frames", rec);
+	destroyHierarchies(&h);
+	createHierarchies(&h, NUMPROPS, PROPFRAMES, 1);
+	printRate("compiled", syncRate(&h, 4, 0), "frames", rec);
+	destroyHierarchies(&h);
+}
+
+Suite frameSuite = { "frames", 1, testFrames, benchFrames };
@@ -0,0 +1,208 @@
+#include "perftest.h"
+
+// Matrix and point kernels against the scalar code they replace.
+// The SIMD versions do the same operations in the same order,
+// so results have to match bit for bit, flags and padding included.
+
+static void
+refMult(Matrix *dst, const Matrix *src1, const Matrix *src2)
+{
+	dst->right.x = src1->right.x*src2->right.x + src1->right.y*src2->up.x + src1->right.z*src2->at.x;
+	dst->right.y = src1->right.x*src2->right.y + src1->right.y*src2->up.y + src1->right.z*src2->at.y;
+	dst->right.z = src1->right.x*src2->right.z + src1->right.y*src2->up.z + src1->right.z*src2->at.z;
+	dst->up.x = src1->up.x*src2->right.x + src1->up.y*src2->up.x + src1->up.z*src2->at.x;
+	dst->up.y = src1->up.x*src2->right.y + src1->up.y*src2->up.y + src1->up.z*src2->at.y;
+	dst->up.z = src1->up.x*src2->right.z + src1->up.y*src2->up.z + src1->up.z*src2->at.z;
+	dst->at.x = src1->at.x*src2->right.x + src1->at.y*src2->up.x + src1->at.z*src2->at.x;
+	dst->at.y = src1->at.x*src2->right.y + src1->at.y*src2->up.y + src1->at.z*src2->at.y;
+	dst->at.z = src1->at.x*src2->right.z + src1->at.y*src2->up.z + src1->at.z*src2->at.z;
+	dst->pos.x = src1->pos.x*src2->right.x + src1->pos.y*src2->up.x + src1->pos.z*src2->at.x + src2->pos.x;
+	dst->pos.y = src1->pos.x*src2->right.y + src1->pos.y*src2->up.y + src1->pos.z*src2->at.y + src2->pos.y;
+	dst->pos.z = src1->pos.x*src2->right.z + src1->pos.y*src2->up.z + src1->pos.z*src2->at.z + src2->pos.z;
+}
+
+static void
+refInvert(Matrix *dst, const Matrix *src)
+{
+	float32 det, invdet;
+	uint32 flags = src->flags;
+	dst->right.x = src->up.y*src->at.z - src->up.z*src->at.y;
+	dst->right.y = src->at.y*src->right.z - src->at.z*src->right.y;
+	dst->right.z = src->right.y*src->up.z - src->right.z*src->up.y;
+	det = src->up.x * dst->right.y + src->at.x * dst->right.z + dst->right.x * src->right.x;
+	invdet = 1.0;
+	if(det != 0.0f)
+		invdet = 1.0f/det;
+	dst->right.x *= invdet;
+	dst->right.y *= invdet;
+	dst->right.z *= invdet;
+	dst->up.x = invdet * (src->up.z*src->at.x - src->up.x*src->at.z);
+	dst->up.y = invdet * (src->at.z*src->right.x - src->at.x*src->right.z);
+	dst->up.z = invdet * (src->right.z*src->up.x - src->right.x*src->up.z);
+	dst->at.x = invdet * (src->up.x*src->at.y - src->up.y*src->at.x);
+	dst->at.y = invdet * (src->at.x*src->right.y - src->at.y*src->right.x);
+	dst->at.z = invdet * (src->right.x*src->up.y - src->right.y*src->up.x);
+	dst->pos.x = -(src->pos.x*dst->right.x + src->pos.y*dst->up.x + src->pos.z*dst->at.x);
+	dst->pos.y = -(src->pos.x*dst->right.y + src->pos.y*dst->up.y + src->pos.z*dst->at.y);
+	dst->pos.z = -(src->pos.x*dst->right.z + src->pos.y*dst->up.z + src->pos.z*dst->at.z);
+	dst->flags = (flags & Matrix::TYPEMASK) == Matrix::TYPEORTHONORMAL ? Matrix::TYPEORTHONORMAL : 0;
+}
+
+static void
+refRawMult(RawMatrix *dst, const RawMatrix *src1, const RawMatrix *src2)
+{
+	const float32 *a = &src1->right.x;
+	const float32 *b = &src2->right.x;
+	float32 *d = &dst->right.x;
+	for(int32 i = 0; i < 4; i++)
+		for(int32 j = 0; j < 4; j++)
+			d[i*4+j] = a[i*4]*b[j] + a[i*4+1]*b[4+j] + a[i*4+2]*b[8+j] + a[i*4+3]*b[12+j];
+}
+
+static void
+refTransformPoints(V3d *out, const V3d *in, int32 n, const Matrix *m)
+{
+	for(int32 i = 0; i < n; i++){
+		V3d p = in[i];
+		out[i].x = p.x*m->right.x + p.y*m->up.x + p.z*m->at.x + m->pos.x;
+		out[i].y = p.x*m->right.y + p.y*m->up.y + p.z*m->at.y + m->pos.y;
+		out[i].z = p.x*m->right.z + p.y*m->up.z + p.z*m->at.z + m->pos.z;
+	}
+}
+
+static void
+refTransformVectors(V3d *out, const V3d *in, int32 n, const Matrix *m)
+{
+	for(int32 i = 0; i < n; i++){
+		V3d p = in[i];
+		out[i].x = p.x*m->right.x + p.y*m->up.x + p.z*m->at.x;
+		out[i].y = p.x*m->right.y + p.y*m->up.y + p.z*m->at.y;
+		out[i].z = p.x*m->right.z + p.y*m->up.z + p.z*m->at.z;
+	}
+}
+
+static void
+randRawMatrix(RawMatrix *m)
+{
+	float32 *f = &m->right.x;
+	for(int32 i = 0; i < 16; i++)
+		f[i] = randFloat();
+}
+
+#define NUMTESTS 200000
+#define MAXPOINTS 40
+
+static int32
+testKernels(void)
+{
+	Matrix a, b, d1, d2;
+	RawMatrix ra, rb, rd1, rd2;
+	V3d in[MAXPOINTS], out1[MAXPOINTS+1], out2[MAXPOINTS];
+	int32 i, n, failed;
+
+	failed = 0;
+	for(i = 0; i < NUMTESTS; i++){
+		randMatrix(&a);
+		randMatrix(&b);
+		randMatrix(&d1);
+		d2 = d1;
+		Matrix::mult_(&d1, &a, &b);
+		refMult(&d2, &a, &b);
+		if(!sameMatrix(&d1, &d2)){
+			printf("  Matrix::mult_ differs\n");
+			failed++;
+		}
+		// singular ones too
+		if(i % 7 == 0)
+			a.up.set(0.0f, 0.0f, 0.0f);
+		Matrix::invertGeneral(&d1, &a);
+		refInvert(&d2, &a);
+		if(!sameMatrix(&d1, &d2)){
+			printf("  Matrix::invertGeneral differs\n");
+			failed++;
+		}
+		randRawMatrix(&ra);
+		randRawMatrix(&rb);
+		RawMatrix::mult(&rd1, &ra, &rb);
+		refRawMult(&rd2, &ra, &rb);
+		if(memcmp(&rd1, &rd2, sizeof(RawMatrix)) != 0){
+			printf("  RawMatrix::mult differs\n");
+			failed++;
+		}
+		if(failed)
+			return failed;
+	}
+
+	// every remainder of the 4-wide loops, in place as well
+	for(n = 0; n < MAXPOINTS; n++){
+		randMatrix(&a);
+		for(i = 0; i < n; i++)
+			in[i].set(randFloat(), randFloat(), randFloat());
+		out1[n].set(1234.0f, 5678.0f, 9012.0f);
+		V3d::transformPoints(out1, in, n, &a);
+		refTransformPoints(out2, in, n, &a);
+		if(memcmp(out1, out2, n*sizeof(V3d)) != 0 ||
+		   out1[n].x != 1234.0f || out1[n].z != 9012.0f){
+			printf("  V3d::transformPoints differs for %d points\n", n);
+			failed++;
+		}
+		memcpy(out1, in, n*sizeof(V3d));
+		V3d::transformPoints(out1, out1, n, &a);
+		if(memcmp(out1, out2, n*sizeof(V3d)) != 0){
+			printf("  V3d::transformPoints in place differs for %d points\n", n);
+			failed++;
+		}
+		V3d::transformVectors(out1, in, n, &a);
+		refTransformVectors(out2, in, n, &a);
+		if(memcmp(out1, out2, n*sizeof(V3d)) != 0){
+			printf("  V3d::transformVectors differs for %d points\n", n);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+#define NUMMATS 1024
+#define NUMPOINTS 4096
+#define REPS 50
+static Matrix matsA[NUMMATS], matsB[NUMMATS], matsD[NUMMATS];
+static RawMatrix rawA[NUMMATS], rawB[NUMMATS], rawD[NUMMATS];
+static V3d pointsIn[NUMPOINTS], pointsOut[NUMPOINTS];
+
+static void benchMult(void) { for(int32 i = 0; i < NUMMATS; i++) Matrix::mult_(&matsD[i], &matsA[i], &matsB[i]); }
+static void benchRefMult(void) { for(int32 i = 0; i < NUMMATS; i++) refMult(&matsD[i], &matsA[i], &matsB[i]); }
+static void benchInvert(void) { for(int32 i = 0; i < NUMMATS; i++) Matrix::invertGeneral(&matsD[i], &matsA[i]); }
+static void benchRefInvert(void) { for(int32 i = 0; i < NUMMATS; i++) refInvert(&matsD[i], &matsA[i]); }
+static void benchRawMult(void) { for(int32 i = 0; i < NUMMATS; i++) RawMatrix::mult(&rawD[i], &rawA[i], &rawB[i]); }
+static void benchRefRawMult(void) { for(int32 i = 0; i < NUMMATS; i++) refRawMult(&rawD[i], &rawA[i], &rawB[i]); }
+static void benchPoints(void) { V3d::transformPoints(pointsOut, pointsIn, NUMPOINTS, &matsA[0]); }
+static void benchRefPoints(void) { refTransformPoints(pointsOut, pointsIn, NUMPOINTS, &matsA[0]); }
+static void benchVectors(void) { V3d::transformVectors(pointsOut, pointsIn, NUMPOINTS, &matsA[0]); }
+static void benchRefVectors(void) { refTransformVectors(pointsOut, pointsIn, NUMPOINTS, &matsA[0]); }
+
+static void
+benchKernels(void)
+{
+	int32 i;
+	for(i = 0; i < NUMMATS; i++){
+		randMatrix(&matsA[i]);
+		randMatrix(&matsB[i]);
+		randRawMatrix(&rawA[i]);
+		randRawMatrix(&rawB[i]);
+	}
+	for(i = 0; i < NUMPOINTS; i++)
+		pointsIn[i].set(randFloat(), randFloat(), randFloat());
+
+	printRate("Matrix::mult_", NUMMATS/bestTime(benchMult, REPS), "matrices",
+		NUMMATS/bestTime(benchRefMult, REPS));
+	printRate("Matrix::invertGeneral", NUMMATS/bestTime(benchInvert, REPS), "matrices",
+		NUMMATS/bestTime(benchRefInvert, REPS));
+	printRate("RawMatrix::mult", NUMMATS/bestTime(benchRawMult, REPS), "matrices",
+		NUMMATS/bestTime(benchRefRawMult, REPS));
+	printRate("V3d::transformPoints", NUMPOINTS/bestTime(benchPoints, REPS), "points",
+		NUMPOINTS/bestTime(benchRefPoints, REPS));
+	printRate("V3d::transformVectors", NUMPOINTS/bestTime(benchVectors, REPS), "points",
+		NUMPOINTS/bestTime(benchRefVectors, REPS));
+}
+
+Suite kernelSuite = { "kernels", 0, testKernels, benchKernels };
@@ -0,0 +1,133 @@
+#include <chrono>
+
+#include "perftest.h"
+
+static Suite *suites[] = {
+	&kernelSuite,
+	&matrixSuite,
+	&frameSuite,
+	&chunkSuite,
+};
+#define NUMSUITES ((int32)nelem(suites))
+
+double
+now(void)
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+double
+bestTime(void (*fn)(void), int32 reps, void (*setup)(void))
+{
+	double t, best = 1e9;
+	for(int32 i = 0; i < reps; i++){
+		if(setup)
+			setup();
+		t = now();
+		fn();
+		t = now() - t;
+		if(t < best)
+			best = t;
+	}
+	return best;
+}
+
+void
+printRate(const char *name, double perSec, const char *unit, double refPerSec)
+{
+	char units[32];
+	snprintf(units, sizeof(units), "%s/s", unit);
+	printf("  %-28s %9.2f M %-12s", name, perSec/1e6, units);
+	if(refPerSec > 0.0)
+		printf(" reference %9.2f M", refPerSec/1e6);
+	printf("\n");
+}
+
+float32
+randFloat(void)
+{
+	return (rand()%20001 - 10000)/1000.0f;
+}
+
+void
+randMatrix(Matrix *m)
+{
+	float32 *f = &m->right.x;
+	for(int32 i = 0; i < 16; i++)
+		f[i] = randFloat();
+	m->flags = rand() & (Matrix::IDENTITY|Matrix::TYPEMASK);
+	m->pad1 = rand();
+	m->pad2 = 0x7FC00000;	// NaN
+	m->pad3 = 1;
+}
+
+bool32
+sameMatrix(const Matrix *a, const Matrix *b)
+{
+	return memcmp(a, b, sizeof(Matrix)) == 0;
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-t] [suite...]\n", argv0);
+	fprintf(stderr, "  -t  only run the tests, no benchmarks\n");
+	fprintf(stderr, "suites:");
+	for(int32 i = 0; i < NUMSUITES; i++)
+		fprintf(stderr, " %s", suites[i]->name);
+	fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	bool32 bench = 1;
+	bool32 run[NUMSUITES];
+	bool32 any = 0;
+	bool32 engineUp = 0;
+	int32 i, j, failed;
+
+	for(i = 0; i < NUMSUITES; i++)
+		run[i] = 0;
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-t") == 0){
+			bench = 0;
+			continue;
+		}
+		for(j = 0; j < NUMSUITES; j++)
+			if(strcmp(argv[i], suites[j]->name) == 0)
+				break;
+		if(j == NUMSUITES){
+			usage(argv[0]);
+			return 1;
+		}
+		run[j] = 1;
+		any = 1;
+	}
+
+	failed = 0;
+	for(i = 0; i < NUMSUITES; i++){
+		if(any && !run[i])
+			continue;
+		if(suites[i]->needsEngine && !engineUp){
+			Engine::init();
+			Engine::open();
+			Engine::start(nil);
+			engineUp = 1;
+		}
+		printf("%s\n", suites[i]->name);
+		srand(1);
+		int32 n = suites[i]->test();
+		printf("  %s\n", n ? "FAILED" : "results match");
+		failed += n;
+		if(bench && n == 0)
+			suites[i]->bench();
+	}
+	if(engineUp){
+		Engine::stop();
+		Engine::close();
+		Engine::term();
+	}
+	return failed != 0;
+}
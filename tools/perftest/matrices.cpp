@@ -0,0 +1,180 @@
+#include "perftest.h"
+
+// Matrix type flags have to stay accurate through the operations
+// that track them, so optimize() and convMatrix can trust them.
+// The batch functions have to match one-at-a-time calls exactly.
+
+#define CHECK(c) if(!(c)){ printf("  line %d: %s\n", __LINE__, #c); failed++; }
+
+static int32
+testFlags(void)
+{
+	Matrix m, t, inv, p;
+	RawMatrix r;
+	V3d axis = { 1.0f, 2.0f, 3.0f };
+	V3d trans = { 1.0f, 0.0f, 0.0f };
+	V3d mirror = { 1.0f, -1.0f, 1.0f };
+	V3d scale = { 2.0f, 3.0f, 4.0f };
+	V3d stretch = { 2.0f, 1.0f, 1.0f };
+	V3d z = { 0.0f, 0.0f, 1.0f };
+	int32 failed;
+
+	failed = 0;
+	m.setIdentity();
+	CHECK(m.flags == (Matrix::IDENTITY|Matrix::TYPEORTHONORMAL));
+	m.rotate(&axis, 30.0f, COMBINEPOSTCONCAT);
+	CHECK(m.flags == Matrix::TYPEORTHONORMAL);
+	m.translate(&trans, COMBINEPOSTCONCAT);
+	CHECK(m.flags == Matrix::TYPEORTHONORMAL);
+	m.scale(&mirror, COMBINEPOSTCONCAT);
+	CHECK(m.flags == Matrix::TYPEORTHONORMAL);
+	t = m;
+	t.optimize();
+	CHECK(t.flags == Matrix::TYPEORTHONORMAL);
+
+	m.setIdentity();
+	m.scale(&scale, COMBINEPOSTCONCAT);
+	CHECK(m.flags == Matrix::TYPEORTHOGONAL);
+	t = m;
+	t.optimize();
+	CHECK(t.flags == Matrix::TYPEORTHOGONAL);
+	m.rotate(&axis, 30.0f, COMBINEPRECONCAT);
+	CHECK(m.flags == Matrix::TYPEORTHOGONAL);
+
+	// the inverse of a scaled matrix isn't orthogonal in general
+	memset(&inv, 0xFF, sizeof(inv));
+	Matrix::invert(&inv, &m);
+	CHECK(inv.flags == 0);
+	Matrix::mult(&p, &m, &inv);
+	p.optimize();
+	CHECK(p.flags & Matrix::IDENTITY);
+	t.setIdentity();
+	t.rotate(&z, 45.0f, COMBINEREPLACE);
+	t.scale(&stretch, COMBINEPRECONCAT);
+	Matrix::invert(&inv, &t);
+	CHECK((inv.flags & Matrix::TYPEORTHOGONAL) == 0);
+	inv.optimize();
+	CHECK((inv.flags & Matrix::TYPEORTHOGONAL) == 0);
+	t.rotate(&axis, 20.0f, COMBINEREPLACE);
+	Matrix::invertGeneral(&inv, &t);
+	CHECK(inv.flags == Matrix::TYPEORTHONORMAL);
+
+	m.setIdentity();
+	m.rotate(&axis, 77.0f, COMBINEREPLACE);
+	m.translate(&trans, COMBINEPOSTCONCAT);
+	convMatrix(&r, &m);
+	convMatrix(&t, &r);
+	CHECK(t.flags == Matrix::TYPEORTHONORMAL);
+	convMatrix(&t, &r, 1);
+	CHECK(t.flags == Matrix::TYPEORTHONORMAL);
+	m.setIdentity();
+	convMatrix(&r, &m);
+	convMatrix(&t, &r);
+	CHECK(t.flags == (Matrix::TYPEORTHONORMAL|Matrix::IDENTITY));
+	convMatrix(&t, &r, 1);
+	CHECK(t.flags == (Matrix::TYPEORTHONORMAL|Matrix::IDENTITY));
+	return failed;
+}
+
+#define NUMMATS 1024
+#define REPS 50
+static Matrix matsA[NUMMATS], matsB[NUMMATS], matsD[NUMMATS], matsE[NUMMATS];
+static RawMatrix rawA[NUMMATS], rawD[NUMMATS], rawE[NUMMATS], rawIdent[NUMMATS];
+
+static void
+randRotation(Matrix *m)
+{
+	V3d v;
+	v.set(randFloat(), randFloat(), randFloat());
+	m->setIdentity();
+	m->rotate(&v, randFloat()*30.0f, COMBINEREPLACE);
+	m->translate(&v, COMBINEPOSTCONCAT);
+}
+
+static void
+setupMatrices(void)
+{
+	Matrix m;
+	int32 i;
+	for(i = 0; i < NUMMATS; i++){
+		randMatrix(&matsA[i]);
+		randMatrix(&matsB[i]);
+		// the batch functions don't look for identities
+		matsA[i].flags &= Matrix::TYPEMASK;
+		matsB[i].flags &= Matrix::TYPEMASK;
+		randRotation(&m);
+		convMatrix(&rawA[i], &m);
+		m.setIdentity();
+		convMatrix(&rawIdent[i], &m);
+	}
+}
+
+static int32
+testBatches(void)
+{
+	int32 i, failed;
+
+	failed = 0;
+	setupMatrices();
+	Matrix::multArray(matsD, matsA, matsB, NUMMATS);
+	for(i = 0; i < NUMMATS; i++)
+		Matrix::mult(&matsE[i], &matsA[i], &matsB[i]);
+	CHECK(memcmp(matsD, matsE, sizeof(matsD)) == 0);
+	Matrix::multArrayByOne(matsD, matsA, &matsB[5], NUMMATS);
+	for(i = 0; i < NUMMATS; i++)
+		Matrix::mult(&matsE[i], &matsA[i], &matsB[5]);
+	CHECK(memcmp(matsD, matsE, sizeof(matsD)) == 0);
+	Matrix::invertArray(matsD, matsA, NUMMATS);
+	for(i = 0; i < NUMMATS; i++)
+		Matrix::invert(&matsE[i], &matsA[i]);
+	CHECK(memcmp(matsD, matsE, sizeof(matsD)) == 0);
+	RawMatrix::transposeArray(rawD, rawA, NUMMATS);
+	for(i = 0; i < NUMMATS; i++)
+		RawMatrix::transpose(&rawE[i], &rawA[i]);
+	CHECK(memcmp(rawD, rawE, sizeof(rawD)) == 0);
+	RawMatrix::transposeArray(rawD, rawD, NUMMATS);
+	CHECK(memcmp(rawD, rawA, sizeof(rawD)) == 0);
+	return failed;
+}
+
+static int32
+testMatrices(void)
+{
+	return testFlags() + testBatches();
+}
+
+static void benchConv(void) { for(int32 i = 0; i < NUMMATS; i++) convMatrix(&matsD[i], &rawA[i]); }
+static void benchConvOrthonormal(void) { for(int32 i = 0; i < NUMMATS; i++) convMatrix(&matsD[i], &rawA[i], 1); }
+static void benchConvIdentity(void) { for(int32 i = 0; i < NUMMATS; i++) convMatrix(&matsD[i], &rawIdent[i]); }
+static void benchMultArray(void) { Matrix::multArray(matsD, matsA, matsB, NUMMATS); }
+static void benchMultLoop(void) { for(int32 i = 0; i < NUMMATS; i++) Matrix::mult(&matsD[i], &matsA[i], &matsB[i]); }
+static void benchMultByOne(void) { Matrix::multArrayByOne(matsD, matsA, &matsB[5], NUMMATS); }
+static void benchMultByOneLoop(void) { for(int32 i = 0; i < NUMMATS; i++) Matrix::mult(&matsD[i], &matsA[i], &matsB[5]); }
+static void benchInvertArray(void) { Matrix::invertArray(matsD, matsA, NUMMATS); }
+static void benchInvertLoop(void) { for(int32 i = 0; i < NUMMATS; i++) Matrix::invert(&matsD[i], &matsA[i]); }
+static void benchTransposeArray(void) { RawMatrix::transposeArray(rawD, rawA, NUMMATS); }
+static void benchTransposeLoop(void) { for(int32 i = 0; i < NUMMATS; i++) RawMatrix::transpose(&rawD[i], &rawA[i]); }
+
+static void
+benchMatrices(void)
+{
+	double conv;
+
+	setupMatrices();
+	// reference is full analysis of the same rotations
+	conv = NUMMATS/bestTime(benchConv, REPS);
+	printRate("convMatrix rotations", conv, "matrices", 0.0);
+	printRate("convMatrix orthonormal", NUMMATS/bestTime(benchConvOrthonormal, REPS), "matrices", conv);
+	printRate("convMatrix identities", NUMMATS/bestTime(benchConvIdentity, REPS), "matrices", conv);
+	// reference is a loop of single calls
+	printRate("Matrix::multArray", NUMMATS/bestTime(benchMultArray, REPS), "matrices",
+		NUMMATS/bestTime(benchMultLoop, REPS));
+	printRate("Matrix::multArrayByOne", NUMMATS/bestTime(benchMultByOne, REPS), "matrices",
+		NUMMATS/bestTime(benchMultByOneLoop, REPS));
+	printRate("Matrix::invertArray", NUMMATS/bestTime(benchInvertArray, REPS), "matrices",
+		NUMMATS/bestTime(benchInvertLoop, REPS));
+	printRate("RawMatrix::transposeArray", NUMMATS/bestTime(benchTransposeArray, REPS), "matrices",
+		NUMMATS/bestTime(benchTransposeLoop, REPS));
+}
+
+Suite matrixSuite = { "matrices", 0, testMatrices, benchMatrices };
@@ -0,0 +1,34 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <rw.h>
+
+using namespace rw;
+
+// Tests compare librw's results with plain reference code,
+// benchmarks print the best of a few runs.
+struct Suite
+{
+	const char *name;
+	bool32 needsEngine;
+	// returns number of failed checks
+	int32 (*test)(void);
+	void (*bench)(void);
+};
+
+extern Suite kernelSuite;
+extern Suite frameSuite;
+extern Suite matrixSuite;
+extern Suite chunkSuite;
+
+double now(void);
+// Seconds the fastest of reps calls of fn took,
+// setup is called before each one and not timed
+double bestTime(void (*fn)(void), int32 reps, void (*setup)(void) = nil);
+void printRate(const char *name, double perSec, const char *unit, double refPerSec);
+
+float32 randFloat(void);
+// Random elements, flags and padding words
+void randMatrix(Matrix *m);
+bool32 sameMatrix(const Matrix *a, const Matrix *b);